@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <string>
+#include <vector>
+
+
+// Keep the compiler from optimizing away a result that is never used
+template <class Type>
+inline void doNotOptimize(const Type& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static const volatile void* sink;
+	sink = &value;
+#endif
+}
+
+
+// Minimal benchmark runner: each case runs once to warm up, then repeatedly until both
+// `minRepetitions` and `minSeconds` are reached. With --json <file>, results are written
+// there with one case per line, so two result files can be compared with a plain diff or
+// with --compare.
+class Benchmark
+{
+public:
+	Benchmark(int argc, char** argv)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string arg = argv[i];
+			if (arg == "--filter" && i + 1 < argc)
+				filter = argv[++i];
+			else if (arg == "--json" && i + 1 < argc)
+				jsonFilename = argv[++i];
+			else if (arg == "--compare" && i + 1 < argc)
+				baseline = load(argv[++i]);
+			else if (arg == "--min-time" && i + 1 < argc)
+				minSeconds = std::stod(argv[++i]);
+			else if (arg == "--quick")
+				quick = true, minSeconds = 0.05, minRepetitions = 1;
+			else
+				inputs.push_back(arg);
+		}
+	}
+
+	~Benchmark() { write(); }
+
+	bool quick = false;
+	std::vector<std::string> inputs;
+
+	bool enabled(const std::string& name) const
+	{
+		return name.find(filter) != std::string::npos;
+	}
+
+	// `items` and `bytes` are processed per call of `function`, used for throughput
+	template <class Function>
+	void run(const std::string& name, Function&& function, double items = 0, double bytes = 0)
+	{
+		if (!enabled(name))
+			return;
+
+		function();
+
+		std::vector<double> samples;
+		double total = 0;
+		while (samples.size() < minRepetitions || total < minSeconds)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			function();
+			const auto end = std::chrono::steady_clock::now();
+			samples.push_back(std::chrono::duration<double>(end - start).count());
+			total += samples.back();
+		}
+
+		std::sort(samples.begin(), samples.end());
+		auto& result = results.emplace_back();
+		result.name = name;
+		result.iterations = samples.size();
+		result.min = samples.front();
+		result.median = samples[samples.size() / 2];
+		result.mean = total / samples.size();
+		result.itemsPerSecond = items / result.median;
+		result.bytesPerSecond = bytes / result.median;
+
+		fprintf(
+			stderr,
+			"%-48s %12.3f ms %8zu runs",
+			name.c_str(),
+			result.median * 1e3,
+			result.iterations);
+		if (items)
+			fprintf(stderr, " %12.0f items/s", result.itemsPerSecond);
+		if (bytes)
+			fprintf(stderr, " %10.2f MB/s", result.bytesPerSecond / 1e6);
+		auto old = baseline.find(name);
+		if (old != baseline.end())
+			fprintf(stderr, "  %+6.1f%%", (result.median / old->second - 1) * 100);
+		fprintf(stderr, "\n");
+	}
+
+private:
+	struct Result
+	{
+		std::string name;
+		size_t iterations;
+		double min, median, mean;
+		double itemsPerSecond, bytesPerSecond;
+	};
+
+	void write() const
+	{
+		if (jsonFilename.empty())
+			return;
+
+		std::ofstream json(jsonFilename);
+		json << "{\n\t\"benchmarks\": [\n";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			auto& r = results[i];
+			json << "\t\t{ \"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+				 << ", \"min_ms\": " << r.min * 1e3 << ", \"median_ms\": " << r.median * 1e3
+				 << ", \"mean_ms\": " << r.mean * 1e3
+				 << ", \"items_per_second\": " << r.itemsPerSecond
+				 << ", \"bytes_per_second\": " << r.bytesPerSecond << " }"
+				 << (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		json << "\t]\n}\n";
+	}
+
+	// median per case from a file written by write()
+	static std::map<std::string, double> load(const std::string& filename)
+	{
+		std::map<std::string, double> output;
+		std::ifstream json(filename);
+		const std::regex pattern(R"re("name": "([^"]+)".*"median_ms": ([0-9.e+-]+))re");
+		std::smatch match;
+		for (std::string line; std::getline(json, line);)
+			if (std::regex_search(line, match, pattern))
+				output[match[1]] = std::stod(match[2]) / 1e3;
+		return output;
+	}
+
+	std::string filter;
+	std::string jsonFilename;  // results are only written when given
+	std::map<std::string, double> baseline;
+	double minSeconds = 0.5;
+	size_t minRepetitions = 5;
+
+	std::vector<Result> results;
+};
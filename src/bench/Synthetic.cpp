@@ -0,0 +1,403 @@
+#include "Synthetic.h"
+#include <algorithm>
+#include <map>
+#include <random>
+#include <sstream>
+
+using namespace std;
+
+
+namespace
+{
+	constexpr float pi = 3.14159265f;
+
+	// big-endian writer for sfnt tables
+	struct Writer
+	{
+		vector<uint8_t> data;
+
+		void u8(uint8_t v) { data.push_back(v); }
+		void u16(uint16_t v) { u8(v >> 8), u8(v & 0xff); }
+		void i16(int16_t v) { u16((uint16_t)v); }
+		void u32(uint32_t v) { u16(v >> 16), u16(v & 0xffff); }
+		void zeros(size_t n) { data.insert(data.end(), n, 0); }
+		void pad() { zeros((4 - data.size() % 4) % 4); }
+	};
+
+	uint32_t checksum(const vector<uint8_t>& data)
+	{
+		uint32_t sum = 0;
+		for (size_t i = 0; i < data.size(); i += 4)
+		{
+			uint32_t word = 0;
+			for (size_t j = 0; j < 4; j++)
+				word = (word << 8) | (i + j < data.size() ? data[i + j] : 0);
+			sum += word;
+		}
+		return sum;
+	}
+
+	struct GlyphOutline
+	{
+		vector<uint16_t> endPoints;
+		vector<int16_t> x, y;
+		vector<bool> onCurve;
+		vector<int16_t> boldX, boldY;  // deltas at the maximum weight
+		int16_t xMin = 0, yMin = 0, xMax = 0, yMax = 0;
+	};
+
+	GlyphOutline makeGlyph(int glyph, int numContours)
+	{
+		GlyphOutline outline;
+		outline.xMin = outline.yMin = INT16_MAX;
+		outline.xMax = outline.yMax = INT16_MIN;
+
+		for (int c = 0; c < numContours; c++)
+		{
+			const float angle = 2 * pi * c / numContours + glyph;
+			const float2 center(500 + 180 * cos(angle), 400 + 180 * sin(angle));
+			const float radius = 150.f + 30 * (c % 3);
+
+			// clockwise circle of 8 on-curve points with tangent off-curve points between
+			for (int k = 0; k < 16; k++)
+			{
+				const bool on = k % 2 == 0;
+				const float r = on ? radius : radius / cos(pi / 8);
+				const float a = -k * pi / 8;
+				const auto x = (int16_t)lround(center.x + r * cos(a));
+				const auto y = (int16_t)lround(center.y + r * sin(a));
+				outline.x.push_back(x);
+				outline.y.push_back(y);
+				outline.onCurve.push_back(on);
+				outline.boldX.push_back((int16_t)lround((x - center.x) / 4));
+				outline.boldY.push_back((int16_t)lround((y - center.y) / 4));
+				outline.xMin = min(outline.xMin, x), outline.xMax = max(outline.xMax, x);
+				outline.yMin = min(outline.yMin, y), outline.yMax = max(outline.yMax, y);
+			}
+			outline.endPoints.push_back((uint16_t)(outline.x.size() - 1));
+		}
+		return outline;
+	}
+
+	void writeGlyph(Writer& glyf, const GlyphOutline& outline)
+	{
+		glyf.i16((int16_t)outline.endPoints.size());
+		glyf.i16(outline.xMin), glyf.i16(outline.yMin);
+		glyf.i16(outline.xMax), glyf.i16(outline.yMax);
+		for (auto end: outline.endPoints)
+			glyf.u16(end);
+		glyf.u16(0);  // no instructions
+
+		// plain 16-bit deltas for both coordinates, only the on-curve bit varies
+		for (auto on: outline.onCurve)
+			glyf.u8(on ? 1 : 0);
+
+		int16_t previous = 0;
+		for (auto x: outline.x)
+			glyf.i16(x - previous), previous = x;
+		previous = 0;
+		for (auto y: outline.y)
+			glyf.i16(y - previous), previous = y;
+		glyf.pad();
+	}
+
+	// packed deltas, as 16-bit runs
+	void writeDeltas(Writer& gvar, const vector<int16_t>& deltas)
+	{
+		for (size_t i = 0; i < deltas.size(); i += 64)
+		{
+			const auto count = min<size_t>(64, deltas.size() - i);
+			gvar.u8((uint8_t)(0x40 | (count - 1)));
+			for (size_t j = i; j < i + count; j++)
+				gvar.i16(deltas[j]);
+		}
+	}
+
+	// one tuple variation with a peak at the maximum of the only axis, for all points
+	void writeGlyphVariations(Writer& gvar, const GlyphOutline& outline)
+	{
+		Writer data;
+		data.u8(0);  // all points
+		auto boldX = outline.boldX, boldY = outline.boldY;
+		boldX.resize(boldX.size() + 4), boldY.resize(boldY.size() + 4);  // phantom points
+		writeDeltas(data, boldX);
+		writeDeltas(data, boldY);
+
+		gvar.u16(1);
+		gvar.u16(4 + 6);
+		gvar.u16((uint16_t)data.data.size());
+		gvar.u16(0x8000 | 0x2000);  // embedded peak tuple, private point numbers
+		gvar.i16(0x4000);           // peak at 1.0
+		gvar.data.insert(gvar.data.end(), data.data.begin(), data.data.end());
+		gvar.zeros(gvar.data.size() % 2);
+	}
+
+	void writeName(Writer& name, const vector<pair<uint16_t, string>>& records)
+	{
+		name.u16(0);
+		name.u16((uint16_t)records.size());
+		name.u16((uint16_t)(6 + 12 * records.size()));
+
+		uint16_t offset = 0;
+		for (auto& [id, value]: records)
+		{
+			name.u16(3), name.u16(1), name.u16(0x409), name.u16(id);
+			name.u16((uint16_t)(value.size() * 2)), name.u16(offset);
+			offset += (uint16_t)(value.size() * 2);
+		}
+		for (auto& record: records)
+			for (auto ch: record.second)
+				name.u16((uint8_t)ch);
+	}
+}
+
+
+vector<uint8_t> Synthetic::font(int numGlyphs, int maxContours, bool variable)
+{
+	numGlyphs = clamp(numGlyphs, 2, 0xffff - '!');
+	const uint16_t firstChar = '!';
+	const uint16_t lastChar = (uint16_t)(firstChar + numGlyphs - 2);
+
+	map<string, Writer> tables;
+
+	// glyf & loca (long offsets); glyph 0 is an empty .notdef
+	auto& glyf = tables["glyf"];
+	auto& loca = tables["loca"];
+	uint16_t maxPoints = 0, maxContoursUsed = 0;
+	Writer glyphVariations;
+	vector<uint32_t> glyphVariationOffsets(2, 0);
+	loca.u32(0);
+	loca.u32(0);
+	for (int glyph = 1; glyph < numGlyphs; glyph++)
+	{
+		const auto outline = makeGlyph(glyph, 1 + glyph % maxContours);
+		writeGlyph(glyf, outline);
+		loca.u32((uint32_t)glyf.data.size());
+		if (variable)
+		{
+			writeGlyphVariations(glyphVariations, outline);
+			glyphVariationOffsets.push_back((uint32_t)glyphVariations.data.size());
+		}
+		maxPoints = max(maxPoints, (uint16_t)outline.x.size());
+		maxContoursUsed = max(maxContoursUsed, (uint16_t)outline.endPoints.size());
+	}
+
+	auto& head = tables["head"];
+	head.u32(0x0001'0000);
+	head.u32(0x0001'0000);
+	head.u32(0);  // checkSumAdjustment, patched below
+	head.u32(0x5F0F'3CF5);
+	head.u16(0x000B);
+	head.u16(1000);  // unitsPerEm
+	head.zeros(16);  // created, modified
+	head.i16(0), head.i16(0), head.i16(1000), head.i16(1000);
+	head.u16(0);     // macStyle
+	head.u16(8);     // lowestRecPPEM
+	head.i16(2);     // fontDirectionHint
+	head.i16(1);     // indexToLocFormat: long
+	head.i16(0);
+
+	auto& hhea = tables["hhea"];
+	hhea.u32(0x0001'0000);
+	hhea.i16(800), hhea.i16(-200), hhea.i16(0);
+	hhea.u16(1000);
+	hhea.i16(0), hhea.i16(0), hhea.i16(1000);
+	hhea.i16(1), hhea.i16(0), hhea.i16(0);
+	hhea.zeros(8);
+	hhea.i16(0);
+	hhea.u16((uint16_t)numGlyphs);
+
+	auto& hmtx = tables["hmtx"];
+	for (int glyph = 0; glyph < numGlyphs; glyph++)
+		hmtx.u16(1000), hmtx.i16(0);
+
+	auto& maxp = tables["maxp"];
+	maxp.u32(0x0001'0000);
+	maxp.u16((uint16_t)numGlyphs);
+	maxp.u16(maxPoints);
+	maxp.u16(maxContoursUsed);
+	maxp.u16(0), maxp.u16(0);
+	maxp.u16(2);
+	maxp.zeros(16);
+
+	// one format 4 subtable with a single delta segment plus the mandatory 0xffff segment
+	auto& cmap = tables["cmap"];
+	cmap.u16(0), cmap.u16(1);
+	cmap.u16(3), cmap.u16(1), cmap.u32(12);
+	cmap.u16(4), cmap.u16(16 + 2 * 4 * 2), cmap.u16(0);
+	cmap.u16(2 * 2), cmap.u16(4), cmap.u16(1), cmap.u16(0);
+	cmap.u16(lastChar), cmap.u16(0xffff);
+	cmap.u16(0);
+	cmap.u16(firstChar), cmap.u16(0xffff);
+	cmap.u16((uint16_t)(1 - firstChar)), cmap.u16(1);
+	cmap.u16(0), cmap.u16(0);
+
+	auto& os2 = tables["OS/2"];
+	os2.u16(4);
+	os2.i16(1000), os2.u16(400), os2.u16(5), os2.u16(0);
+	os2.zeros(16);
+	os2.i16(50), os2.i16(250), os2.i16(0);
+	os2.zeros(10 + 16);
+	os2.u8('S'), os2.u8('Y'), os2.u8('N'), os2.u8('T');
+	os2.u16(0x40), os2.u16(firstChar), os2.u16(lastChar);
+	os2.i16(800), os2.i16(-200), os2.i16(0), os2.u16(1000), os2.u16(200);
+	os2.u32(1), os2.u32(0);
+	os2.i16(500), os2.i16(700), os2.u16(0), os2.u16(' '), os2.u16(0);
+
+	writeName(
+		tables["name"],
+		{ { 1, "Synthetic" },
+		  { 2, "Regular" },
+		  { 4, "Synthetic" },
+		  { 256, "Weight" },
+		  { 257, "Thin" },
+		  { 258, "Black" } });
+
+	if (variable)
+	{
+		auto& fvar = tables["fvar"];
+		fvar.u16(1), fvar.u16(0);
+		fvar.u16(16), fvar.u16(2);
+		fvar.u16(1), fvar.u16(20);  // one axis
+		fvar.u16(2), fvar.u16(8);   // two named instances
+		fvar.u8('w'), fvar.u8('g'), fvar.u8('h'), fvar.u8('t');
+		fvar.u32(100 << 16), fvar.u32(400 << 16), fvar.u32(900 << 16);
+		fvar.u16(0), fvar.u16(256);
+		fvar.u16(257), fvar.u16(0), fvar.u32(100 << 16);
+		fvar.u16(258), fvar.u16(0), fvar.u32(900 << 16);
+
+		auto& gvar = tables["gvar"];
+		const auto dataOffset = (uint32_t)(20 + 4 * glyphVariationOffsets.size());
+		gvar.u16(1), gvar.u16(0);
+		gvar.u16(1), gvar.u16(0);
+		gvar.u32(dataOffset);  // no shared tuples
+		gvar.u16((uint16_t)numGlyphs);
+		gvar.u16(1);  // long offsets
+		gvar.u32(dataOffset);
+		for (auto offset: glyphVariationOffsets)
+			gvar.u32(offset);
+		gvar.data.insert(
+			gvar.data.end(),
+			glyphVariations.data.begin(),
+			glyphVariations.data.end());
+	}
+
+	auto& post = tables["post"];
+	post.u32(0x0003'0000);
+	post.zeros(28);
+
+	// table directory; std::map already sorts tags in the required order
+	Writer file;
+	const auto numTables = (uint16_t)tables.size();
+	uint16_t searchRange = 1, entrySelector = 0;
+	while (searchRange * 2 <= numTables)
+		searchRange *= 2, entrySelector++;
+	file.u32(0x0001'0000);
+	file.u16(numTables);
+	file.u16(searchRange * 16), file.u16(entrySelector);
+	file.u16(numTables * 16 - searchRange * 16);
+
+	auto offset = (uint32_t)(12 + 16 * numTables);
+	size_t headOffset = 0;
+	for (auto& [tag, table]: tables)
+	{
+		for (auto ch: tag)
+			file.u8(ch);
+		file.u32(checksum(table.data));
+		file.u32(offset);
+		file.u32((uint32_t)table.data.size());
+		if (tag == "head")
+			headOffset = offset;
+		offset += (uint32_t)((table.data.size() + 3) / 4 * 4);
+	}
+	for (auto& entry: tables)
+	{
+		file.data.insert(file.data.end(), entry.second.data.begin(), entry.second.data.end());
+		file.pad();
+	}
+
+	const auto adjustment = 0xB1B0'AFBA - checksum(file.data);
+	for (int i = 0; i < 4; i++)
+		file.data[headOffset + 8 + i] = (uint8_t)(adjustment >> (24 - 8 * i));
+
+	return file.data;
+}
+
+
+string Synthetic::text(size_t length, int numGlyphs)
+{
+	const int range = clamp(numGlyphs - 1, 1, 0x7f - '!');
+
+	string output;
+	for (size_t i = 0; i < length; i++)
+		output += (i % 60 == 59) ? '\n' : (char)('!' + i % range);
+	return output;
+}
+
+
+string Synthetic::svg(int numShapes, int pathsPerShape)
+{
+	mt19937 random(26);
+	uniform_real_distribution<float> position(0, 1000);
+	uniform_real_distribution<float> size(5, 40);
+
+	ostringstream svg;
+	svg << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"1000\" height=\"1000\">\n";
+
+	for (int shape = 0; shape < numShapes; shape++)
+	{
+		svg << "<path fill=\"#" << hex << (random() & 0xff'ffff) << dec << "\" d=\"";
+		for (int path = 0; path < pathsPerShape; path++)
+		{
+			// circle made of four cubic arcs
+			const float x = position(random), y = position(random), r = size(random);
+			const float k = 0.5523f * r;
+			svg << "M" << x + r << "," << y;
+			svg << "C" << x + r << "," << y + k << " " << x + k << "," << y + r << " " << x
+				<< "," << y + r;
+			svg << "C" << x - k << "," << y + r << " " << x - r << "," << y + k << " " << x - r
+				<< "," << y;
+			svg << "C" << x - r << "," << y - k << " " << x - k << "," << y - r << " " << x
+				<< "," << y - r;
+			svg << "C" << x + k << "," << y - r << " " << x + r << "," << y - k << " " << x + r
+				<< "," << y << "Z";
+		}
+		svg << "\"/>\n";
+	}
+
+	svg << "</svg>\n";
+	return svg.str();
+}
+
+
+vector<vector<float2>> Synthetic::paths(int numPaths, int pointsPerPath)
+{
+	mt19937 random(27);
+	uniform_real_distribution<float> position(0.05f, 0.95f);
+	uniform_real_distribution<float> size(0.01f, 0.05f);
+
+	vector<vector<float2>> output(numPaths);
+	for (auto& path: output)
+	{
+		const float2 center(position(random), position(random));
+		const float radius = size(random);
+		for (int i = 0; i < pointsPerPath; i++)
+		{
+			const float angle = 2 * pi * i / pointsPerPath;
+			path.push_back(center + float2(cos(angle), sin(angle)) * radius);
+		}
+	}
+	return output;
+}
+
+
+vector<float2> Synthetic::curves(int numCurves, int pointsPerCurve)
+{
+	mt19937 random(28);
+	uniform_real_distribution<float> position(0, 1);
+
+	vector<float2> output(numCurves * pointsPerCurve);
+	for (auto& p: output)
+		p = float2(position(random), position(random));
+	return output;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../utils/Math.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+// Deterministic inputs for the benchmarks, so runs on different machines and releases are
+// comparable. Sizes are parameters to allow measuring how each stage scales.
+namespace Synthetic
+{
+	// TrueType font with `numGlyphs` glyphs; glyph i has 1 + i % maxContours overlapping
+	// quadratic contours. Code points starting at '!' map to glyphs 1, 2, ... A variable
+	// font has a weight axis (100 to 900, default 400) growing every contour by a quarter.
+	std::vector<uint8_t> font(int numGlyphs, int maxContours = 4, bool variable = false);
+
+	// Text that only uses characters mapped by font(numGlyphs)
+	std::string text(size_t length, int numGlyphs);
+
+	// SVG document with `numShapes` filled shapes, each made of `pathsPerShape` cubic paths
+	std::string svg(int numShapes, int pathsPerShape = 4);
+
+	// Overlapping closed polygons (circles with `pointsPerPath` points) in unit square
+	std::vector<std::vector<float2>> paths(int numPaths, int pointsPerPath = 64);
+
+	// Random curve control points: 3 per quadratic or 4 per cubic curve
+	std::vector<float2> curves(int numCurves, int pointsPerCurve);
+}
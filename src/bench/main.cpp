@@ -0,0 +1,589 @@
+#include "Benchmark.h"
+#include "Synthetic.h"
+#include "../graphics/Mesh.h"
+#include "../graphics/SVG.h"
+#include "../text/Font.h"
+#include "../text/Outline.h"
+#include "../utils/Compression.h"
+#include <woff2/encode.h>
+
+using namespace std;
+
+
+// Same conversions as Collection, so the stages can be timed in isolation
+
+ClipperLib::Paths toClipper(const vector<vector<float2>>& paths)
+{
+	ClipperLib::Paths output;
+	for (auto& points: paths)
+	{
+		auto& path = output.emplace_back();
+		for (const auto& p: points)
+			path.emplace_back(llround(p.x * 100'000.0), llround(p.y * 100'000.0));
+	}
+	return output;
+}
+
+ClipperLib::Paths unionPaths(const ClipperLib::Paths& paths)
+{
+	ClipperLib::Paths solution;
+	ClipperLib::Clipper clipper;
+	clipper.AddPaths(paths, ClipperLib::ptSubject, true);
+	clipper.Execute(
+		ClipperLib::ctUnion,
+		solution,
+		ClipperLib::pftNonZero,
+		ClipperLib::pftNonZero);
+	return solution;
+}
+
+int tessellate(const ClipperLib::Paths& solution)
+{
+	auto tess = tessNewTess(nullptr);
+	vector<float2> tessInput;
+	for (const auto& path: solution)
+	{
+		tessInput.clear();
+		for (const auto& pt: path)
+			tessInput.push_back({ float(pt.X / 100'000.0), float(pt.Y / 100'000.0) });
+		tessAddContour(tess, 2, tessInput.data(), sizeof(float2), tessInput.size());
+	}
+
+	int triangles = 0;
+	if (tessTesselate(tess, TESS_WINDING_ODD, TESS_POLYGONS, 3, 2, nullptr))
+		triangles = tessGetElementCount(tess);
+	tessDeleteTess(tess);
+	return triangles;
+}
+
+// Largest distance from a point of `path` to the polyline `simplified`
+float deviation(const vector<float2>& path, const vector<float2>& simplified)
+{
+	float largest = 0;
+	for (const auto& p: path)
+	{
+		float nearest = numeric_limits<float>::max();
+		for (size_t i = 0; i + 1 < simplified.size(); i++)
+		{
+			const auto ab = simplified[i + 1] - simplified[i];
+			const auto d = p - simplified[i];
+			const auto length = dot(ab, ab);
+			const auto t = length > 0 ? clamp(dot(d, ab) / length, 0.0f, 1.0f) : 0.0f;
+			const auto offset = d - ab * t;
+			nearest = min(nearest, dot(offset, offset));
+		}
+		largest = max(largest, nearest);
+	}
+	return sqrt(largest);
+}
+
+// Whether GlyfTable read the points FreeType loads for the same glyph
+bool sameOutline(const GlyfOutline& glyf, const FT_Outline& outline)
+{
+	if (glyf.points.size() != (size_t)outline.n_points
+		|| glyf.contourEnds.size() != (size_t)outline.n_contours)
+		return false;
+	for (int i = 0; i < outline.n_contours; i++)
+		if (glyf.contourEnds[i] != outline.contours[i])
+			return false;
+	for (int i = 0; i < outline.n_points; i++)
+		if (glyf.points[i].x != outline.points[i].x || glyf.points[i].y != outline.points[i].y
+			|| glyf.onCurve[i] != (FT_CURVE_TAG(outline.tags[i]) == FT_CURVE_TAG_ON))
+			return false;
+	return true;
+}
+
+
+void benchmarkFonts(Benchmark& bench, const filesystem::path& folder)
+{
+	for (int numGlyphs: bench.quick ? vector<int> { 64 } : vector<int> { 64, 512, 4096 })
+	{
+		const auto suffix = "/glyphs=" + to_string(numGlyphs);
+		const auto ttf = Synthetic::font(numGlyphs);
+		const auto ttfFile = folder / ("font" + to_string(numGlyphs) + ".ttf");
+		File::writeAll(ttf, ttfFile);
+
+		vector<uint8_t> woff2(woff2::MaxWOFF2CompressedSize(ttf.data(), ttf.size()));
+		auto woff2Size = woff2.size();
+		if (woff2::ConvertTTFToWOFF2(ttf.data(), ttf.size(), woff2.data(), &woff2Size))
+		{
+			woff2.resize(woff2Size);
+			const auto woff2File = folder / ("font" + to_string(numGlyphs) + ".woff2");
+			File::writeAll(woff2, woff2File);
+
+			bench.run(
+				"woff2_decode" + suffix,
+				[&]() { doNotOptimize(decodeWOFF2(woff2.data(), woff2.size())); },
+				numGlyphs,
+				ttf.size());
+			bench.run(
+				"font_load/woff2" + suffix,
+				[&]() { FontData font(woff2File); },
+				numGlyphs,
+				ttf.size());
+		}
+		bench.run(
+			"font_load/ttf" + suffix,
+			[&]() { FontData font(ttfFile); },
+			numGlyphs,
+			ttf.size());
+
+		FT_Library library;
+		FT_Face face;
+		FT_Init_FreeType(&library);
+		FT_New_Memory_Face(library, ttf.data(), ttf.size(), 0, &face);
+		const float scale = 1.0f / face->units_per_EM;
+
+		bench.run(
+			"outline_decompose" + suffix,
+			[&]()
+			{
+				Contours contours;
+				for (FT_UInt glyph = 0; glyph < face->num_glyphs; glyph++)
+				{
+					contours.clear();
+					if (!FT_Load_Glyph(face, glyph, FT_LOAD_NO_SCALE | FT_LOAD_NO_HINTING))
+						decomposeOutline(&face->glyph->outline, scale, contours);
+					doNotOptimize(contours);
+				}
+			},
+			numGlyphs);
+
+		const GlyfTable glyf(ttf.data(), ttf.size());
+		bench.run(
+			"outline_decompose/glyf" + suffix,
+			[&]()
+			{
+				Contours contours;
+				GlyfOutline outline;
+				for (unsigned glyph = 0; glyph < (unsigned)face->num_glyphs; glyph++)
+				{
+					contours.clear();
+					if (glyf.read(glyph, outline))
+						decomposeOutline(&outline, scale, contours);
+					doNotOptimize(contours);
+				}
+			},
+			numGlyphs);
+
+		// Synthetic glyphs have a left side bearing of 0 and start well right of it, so this
+		// checks that GlyfTable moves points by lsb - xMin the way FreeType does
+		GlyfOutline outline;
+		if (bench.enabled("outline_decompose/glyf" + suffix))
+			for (unsigned glyph = 0; glyph < (unsigned)face->num_glyphs; glyph++)
+				if (glyf.read(glyph, outline) && !FT_Load_Glyph(face, glyph, FT_LOAD_NO_SCALE)
+					&& !sameOutline(outline, face->glyph->outline))
+					throw runtime_error("outline_decompose/glyf: glyph " + to_string(glyph)
+										+ " is not FreeType's");
+
+		FT_Done_Face(face);
+		FT_Done_FreeType(library);
+
+		bench.run(
+			"e2e/font_freetype_libtess" + suffix,
+			[&]() { saveFontUsingFreeTypeAndLibTess(ttfFile); },
+			numGlyphs);
+
+		FontOptions lod;
+		lod.levelsOfDetail = 4;
+		bench.run(
+			"e2e/font_freetype_libtess/lod=4" + suffix,
+			[&]() { saveFontUsingFreeTypeAndLibTess(ttfFile, lod); },
+			numGlyphs);
+
+		FontOptions composites;
+		composites.instanceComposites = true;
+		bench.run(
+			"e2e/font_freetype_libtess/composites" + suffix,
+			[&]() { saveFontUsingFreeTypeAndLibTess(ttfFile, composites); },
+			numGlyphs);
+
+		const auto variableFile = folder / ("variable" + to_string(numGlyphs) + ".ttf");
+		File::writeAll(Synthetic::font(numGlyphs, 4, true), variableFile);
+		FontOptions variations;
+		variations.variations = true;
+		bench.run(
+			"e2e/font_freetype_libtess/variations" + suffix,
+			[&]() { saveFontUsingFreeTypeAndLibTess(variableFile, variations); },
+			numGlyphs);
+		bench.run(
+			"e2e/font_ttf2mesh" + suffix,
+			[&]() { saveFont_ttf2mesh(ttfFile); },
+			numGlyphs);
+
+		const auto text = Synthetic::text(bench.quick ? 1000 : 10'000, numGlyphs);
+		bench.run(
+			"harfbuzz_shape" + suffix + "/chars=" + to_string(text.size()),
+			[&]() { doNotOptimize(shapeWithHarfbuzz(text, ttfFile)); },
+			text.size());
+	}
+}
+
+void benchmarkFlattening(Benchmark& bench)
+{
+	const int numCurves = 10'000;
+
+	const auto quadratic = Synthetic::curves(numCurves, 3);
+	bench.run(
+		"bezier_flatten/quadratic",
+		[&]()
+		{
+			vector<float2> contour;
+			for (size_t i = 0; i < quadratic.size(); i += 3)
+			{
+				contour.assign(1, quadratic[i]);
+				flattenQuadratic(contour, quadratic[i + 1], quadratic[i + 2], CURVES_PRECISION);
+				doNotOptimize(contour);
+			}
+		},
+		numCurves);
+
+	const auto cubic = Synthetic::curves(numCurves, 4);
+	bench.run(
+		"bezier_flatten/cubic",
+		[&]()
+		{
+			vector<float2> contour;
+			for (size_t i = 0; i < cubic.size(); i += 4)
+			{
+				contour.assign(1, cubic[i]);
+				flattenCubic(contour, cubic[i + 1], cubic[i + 2], cubic[i + 3], CURVES_PRECISION);
+				doNotOptimize(contour);
+			}
+		},
+		numCurves);
+}
+
+void benchmarkGeometry(Benchmark& bench)
+{
+	// long runs of nearly collinear points, whose error must stay within the tolerance
+	vector<float2> arc;
+	for (int i = 0; i < 20'000; i++)
+	{
+		const auto angle = 3.14159265f * i / 19'999;
+		arc.push_back(float2(cos(angle), sin(angle)) * 100.0f);
+	}
+	const auto tolerance = 0.05f;
+	vector<float2> simplified;
+	bench.run(
+		"path_simplify/arc",
+		[&]() { simplifyPath(arc, tolerance, simplified); },
+		arc.size());
+	if (bench.enabled("path_simplify/arc") && deviation(arc, simplified) > tolerance)
+		throw runtime_error("path_simplify/arc: simplified path is off by more than tolerance");
+
+	for (int numPaths: bench.quick ? vector<int> { 100 } : vector<int> { 10, 100, 1000, 5000 })
+	{
+		const auto suffix = "/paths=" + to_string(numPaths);
+		const auto points = Synthetic::paths(numPaths);
+		const auto paths = toClipper(points);
+
+		bench.run(
+			"path_simplify" + suffix,
+			[&]()
+			{
+				vector<float2> simplified;
+				for (const auto& path: points)
+				{
+					simplifyPath(path, 0.001f, simplified);
+					doNotOptimize(simplified);
+				}
+			},
+			numPaths);
+
+		bench.run(
+			"clipper_union" + suffix,
+			[&]() { doNotOptimize(unionPaths(paths)); },
+			numPaths);
+
+		const auto solution = unionPaths(paths);
+		bench.run(
+			"libtess2_tessellate" + suffix,
+			[&]() { doNotOptimize(tessellate(solution)); },
+			numPaths);
+
+		for (const bool islands: { false, true })
+			bench.run(
+				string(islands ? "collection_mesh/islands" : "collection_mesh") + suffix,
+				[&]()
+				{
+					Collection collection(false);
+					collection.setSplitIslands(islands);
+					for (const auto& path: points)
+						collection.addPath(path);
+					doNotOptimize(collection.getIndices());
+				},
+				numPaths);
+	}
+}
+
+// One Clipper call against unionBatches and the final union of what it leaves, over inputs
+// growing past the point where the hierarchical union starts to win
+void benchmarkUnion(Benchmark& bench)
+{
+	const auto sizes = bench.quick ? vector<int> { 256, 2048 }
+								   : vector<int> { 128, 256, 512, 1024, 2048, 4096, 8192 };
+	for (int numPaths: sizes)
+	{
+		const auto suffix = "/paths=" + to_string(numPaths);
+		const auto paths = toClipper(Synthetic::paths(numPaths));
+
+		bench.run(
+			"union/single" + suffix,
+			[&]() { doNotOptimize(unionPaths(paths)); },
+			numPaths);
+		bench.run(
+			"union/hierarchical" + suffix,
+			[&]()
+			{
+				auto batches = paths;
+				unionBatches(batches);
+				doNotOptimize(unionPaths(batches));
+			},
+			numPaths);
+	}
+}
+
+void benchmarkStorage(Benchmark& bench, const filesystem::path& folder)
+{
+	// realistic payload: the tessellation of a few thousand overlapping circles
+	const auto paths = toClipper(Synthetic::paths(bench.quick ? 500 : 5000));
+	auto tess = tessNewTess(nullptr);
+	for (const auto& path: unionPaths(paths))
+	{
+		vector<float2> points;
+		for (const auto& pt: path)
+			points.push_back({ pt.X / 100000.0f, pt.Y / 100000.0f });
+		tessAddContour(tess, 2, points.data(), sizeof(float2), points.size());
+	}
+	tessTesselate(tess, TESS_WINDING_ODD, TESS_POLYGONS, 3, 2, nullptr);
+	const vector<float2> vertices(
+		(float2*)tessGetVertices(tess),
+		(float2*)tessGetVertices(tess) + tessGetVertexCount(tess));
+	const vector<uint32_t> indices(
+		(uint32_t*)tessGetElements(tess),
+		(uint32_t*)tessGetElements(tess) + tessGetElementCount(tess) * 3);
+	tessDeleteTess(tess);
+
+	const auto bytes = vertices.size() * sizeof(float2);
+	for (int level: { 1, 5, 9, 11 })
+	{
+		const auto suffix = "/level=" + to_string(level);
+		bench.run(
+			"brotli_compress" + suffix,
+			[&]() { doNotOptimize(compress(vertices, Compression::Brotli, level)); },
+			0,
+			bytes);
+
+		const auto compressed = compress(vertices, Compression::Brotli, level);
+		bench.run(
+			"brotli_decompress" + suffix,
+			[&]() { doNotOptimize(decompress(compressed, Compression::Brotli)); },
+			0,
+			bytes);
+	}
+
+	const auto packFile = folder / "pack.bin";
+	const auto packBytes = bytes + indices.size() * sizeof(uint32_t);
+	bench.run(
+		"pack_save",
+		[&]()
+		{
+			File::Pack output(packFile, 'w', "FNTMSH");
+			output.add("vert", vertices, 20);
+			output.add("idx", indices, 20);
+		},
+		0,
+		packBytes);
+	bench.run(
+		"pack_load",
+		[&]()
+		{
+			File::Pack input(packFile, 'r', "FNTMSH");
+			doNotOptimize(input.get<float2>("vert"));
+			doNotOptimize(input.get<uint32_t>("idx"));
+		},
+		0,
+		packBytes);
+	bench.run(
+		"pack_load_parallel",
+		[&]()
+		{
+			File::Pack input(packFile, 'r', "FNTMSH");
+			doNotOptimize(input.getMany<float2, uint32_t>({ "vert", "idx" }));
+		},
+		0,
+		packBytes);
+
+	// the same blocks compressed for fast loads and for size
+	const pair<string, CompressionTarget> targets[] = { { "runtime", { 1000 } },
+														{ "archive", {} } };
+	for (const auto& [name, target]: targets)
+	{
+		const auto autoFile = folder / ("pack_" + name + ".bin");
+		bench.run(
+			"pack_save/auto=" + name,
+			[&]()
+			{
+				File::Pack output(autoFile, 'w', "FNTMSH");
+				output.setCompressionTarget(target);
+				output.add("vert", vertices, 20);
+				output.add("idx", indices, 20);
+			},
+			0,
+			packBytes);
+		bench.run(
+			"pack_load/auto=" + name,
+			[&]()
+			{
+				File::Pack input(autoFile, 'r', "FNTMSH");
+				doNotOptimize(input.get<float2>("vert"));
+				doNotOptimize(input.get<uint32_t>("idx"));
+			},
+			0,
+			packBytes);
+	}
+}
+
+#if defined(ENABLE_ZSTD)
+// Per-glyph blocks compressed against a trained dictionary, which must read back byte for
+// byte from the pack and from a bundle that copied them under a prefix
+void benchmarkDictionary(Benchmark& bench, const filesystem::path& folder)
+{
+	const int numGlyphs = bench.quick ? 128 : 1024;
+	const auto paths = Synthetic::paths(3 * numGlyphs);
+	vector<vector<uint8_t>> glyphs;
+	size_t bytes = 0;
+	for (int glyph = 0; glyph < numGlyphs; glyph++)
+	{
+		Collection collection(false);
+		for (int i = 0; i < 3; i++)
+			collection.addPath(paths[3 * glyph + i]);
+		const auto& vertices = collection.getVertices();
+		const auto* data = (const uint8_t*)vertices.data();
+		glyphs.emplace_back(data, data + vertices.size() * sizeof(float2));
+		bytes += glyphs.back().size();
+	}
+
+	const auto packFile = folder / "glyphs.bin";
+	auto save = [&]()
+	{
+		File::Pack output(packFile, 'w', "FNTMSH");
+		output.addDictionary("dictionary", glyphs);
+		for (int glyph = 0; glyph < numGlyphs; glyph++)
+			output.add("glyph" + to_string(glyph), glyphs[glyph], 9);
+	};
+	save();
+	bench.run("pack_save/dictionary", save, numGlyphs, bytes);
+	bench.run(
+		"pack_load/dictionary",
+		[&]()
+		{
+			File::Pack input(packFile, 'r', "FNTMSH");
+			for (int glyph = 0; glyph < numGlyphs; glyph++)
+				doNotOptimize(input.get<uint8_t>("glyph" + to_string(glyph)));
+		},
+		numGlyphs,
+		bytes);
+
+	const auto bundleFile = folder / "glyphs.bundle";
+	{
+		File::Pack input(packFile, 'r', "FNTMSH");
+		File::Pack bundle(bundleFile, 'w', FONT_BUNDLE_SIGNATURE);
+		for (const auto& name: input.names())
+			bundle.copy(input, name, bundleBlock("glyphs", ""));
+	}
+
+	File::Pack input(packFile, 'r', "FNTMSH");
+	File::Pack bundle(bundleFile, 'r', FONT_BUNDLE_SIGNATURE);
+	for (int glyph = 0; glyph < numGlyphs; glyph++)
+	{
+		const auto name = "glyph" + to_string(glyph);
+		if (input.get<uint8_t>(name) != glyphs[glyph]
+			|| bundle.get<uint8_t>(bundleBlock("glyphs", name)) != glyphs[glyph])
+			throw runtime_error("pack_load/dictionary: " + name + " does not read back");
+	}
+}
+#endif
+
+void benchmarkSVG(Benchmark& bench, const filesystem::path& folder)
+{
+	for (int numShapes: bench.quick ? vector<int> { 100 } : vector<int> { 100, 1000, 10'000 })
+	{
+		const auto svgFile = folder / ("shapes" + to_string(numShapes) + ".svg");
+		File::writeAll(Synthetic::svg(numShapes), svgFile);
+		bench.run(
+			"e2e/svg/shapes=" + to_string(numShapes),
+			[&]() { saveSVG(svgFile); },
+			numShapes);
+
+		SVGOptions parallel;
+		parallel.parallel = true;
+		bench.run(
+			"e2e/svg_parallel/shapes=" + to_string(numShapes),
+			[&]() { saveSVG(svgFile, parallel); },
+			numShapes);
+
+		SVGOptions streaming;
+		streaming.streaming = true;
+		bench.run(
+			"e2e/svg_streaming/shapes=" + to_string(numShapes),
+			[&]() { saveSVG(svgFile, streaming); },
+			numShapes);
+
+		SVGOptions tiled;
+		tiled.tileSize = 250;
+		bench.run(
+			"e2e/svg_tiled/shapes=" + to_string(numShapes),
+			[&]() { saveSVG(svgFile, tiled); },
+			numShapes);
+	}
+}
+
+// Inputs are converted from a copy in `folder`, so that their packs are not written next to
+// the originals, which may be read-only
+void benchmarkInputs(Benchmark& bench, const filesystem::path& folder)
+{
+	const auto copies = folder / "inputs";
+	for (const filesystem::path original: bench.inputs)
+	{
+		filesystem::create_directories(copies);
+		const auto input = copies / original.filename();
+		filesystem::copy_file(original, input);
+
+		const auto name = input.filename().u8string();
+		if (input.extension() == ".svg")
+			bench.run("e2e/svg/" + name, [&]() { saveSVG(input); });
+		else
+		{
+			bench.run(
+				"e2e/font_freetype_libtess/" + name,
+				[&]() { saveFontUsingFreeTypeAndLibTess(input); });
+			bench.run("e2e/font_ttf2mesh/" + name, [&]() { saveFont_ttf2mesh(input); });
+		}
+		filesystem::remove_all(copies);
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	Benchmark bench(argc, argv);
+
+	const auto folder = filesystem::temp_directory_path() / "NativeSandboxBench";
+	filesystem::create_directories(folder);
+
+	benchmarkFlattening(bench);
+	benchmarkGeometry(bench);
+	benchmarkUnion(bench);
+	benchmarkStorage(bench, folder);
+#if defined(ENABLE_ZSTD)
+	benchmarkDictionary(bench, folder);
+#endif
+	benchmarkFonts(bench, folder);
+	benchmarkSVG(bench, folder);
+	benchmarkInputs(bench, folder);
+
+	filesystem::remove_all(folder);
+	return 0;
+}
@@ -1,22 +1,472 @@
 #include "Mesh.h"
+#include "../utils/Parallel.h"
+#include <cstring>
+#include <limits>
 
 
+namespace
+{
+	void printSimplification(size_t pathPoints, size_t keptPoints)
+	{
+		if (keptPoints < pathPoints)
+			printf(
+				"  %zu of %zu path points left after simplification (%.1f%%)\n",
+				keptPoints,
+				pathPoints,
+				100.0 * keptPoints / pathPoints);
+	}
+
+	template <class Type>
+	void spill(FILE*& file, const std::vector<Type>& data)
+	{
+		if (!file && !(file = tmpfile()))
+			throw std::runtime_error("Unable to create temporary file");
+		fwrite(data.data(), sizeof(Type), data.size(), file);
+	}
+
+	// copy a temporary file into a new block and close it
+	template <class Type>
+	void unspill(FILE*& file, File::Pack& output, const std::string& name)
+	{
+		auto block = output.addStream<Type>(name, 20);
+		if (file)
+		{
+			std::vector<uint8_t> buffer(1 << 20);
+			rewind(file);
+			for (size_t size; (size = fread(buffer.data(), 1, buffer.size(), file)) > 0;)
+				block->write(buffer.data(), size);
+			fclose(file);
+			file = nullptr;
+		}
+		block->finish();
+	}
+}
+
+
+void unionBatches(ClipperLib::Paths& paths, size_t batchSize)
+{
+	if (paths.size() <= batchSize)
+		return;
+
+	TRACE_ZONE("union/batches");
+
+	// batches of paths close to each other along a Morton curve through their centers
+	auto limit = std::numeric_limits<ClipperLib::cInt>::max();
+	ClipperLib::IntRect bounds = { limit, limit, -limit, -limit };
+	std::vector<ClipperLib::IntPoint> centers(paths.size());
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		ClipperLib::IntRect box = { limit, limit, -limit, -limit };
+		for (const auto& p: paths[i])
+		{
+			box.left = std::min(box.left, p.X);
+			box.top = std::min(box.top, p.Y);
+			box.right = std::max(box.right, p.X);
+			box.bottom = std::max(box.bottom, p.Y);
+		}
+		if (paths[i].empty())
+			continue;
+		centers[i] = { box.left / 2 + box.right / 2, box.top / 2 + box.bottom / 2 };
+		bounds.left = std::min(bounds.left, centers[i].X);
+		bounds.top = std::min(bounds.top, centers[i].Y);
+		bounds.right = std::max(bounds.right, centers[i].X);
+		bounds.bottom = std::max(bounds.bottom, centers[i].Y);
+	}
+
+	auto spread = [](uint32_t v)
+	{
+		v = (v | (v << 8)) & 0x00ff'00ff;
+		v = (v | (v << 4)) & 0x0f0f'0f0f;
+		v = (v | (v << 2)) & 0x3333'3333;
+		return (v | (v << 1)) & 0x5555'5555;
+	};
+	const auto width = std::max<double>((double)bounds.right - bounds.left, 1);
+	const auto height = std::max<double>((double)bounds.bottom - bounds.top, 1);
+	std::vector<std::pair<uint32_t, uint32_t>> order(paths.size());
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		const auto x = paths[i].empty() ? 0 : (centers[i].X - bounds.left) * 65535.0 / width;
+		const auto y = paths[i].empty() ? 0 : (centers[i].Y - bounds.top) * 65535.0 / height;
+		order[i] = { spread((uint32_t)x) | (spread((uint32_t)y) << 1), (uint32_t)i };
+	}
+	std::sort(order.begin(), order.end());
+
+	std::vector<ClipperLib::Paths> parts((paths.size() + batchSize - 1) / batchSize);
+	Parallel::forEach(
+		parts.size(),
+		[&](size_t batch)
+		{
+			ClipperLib::Clipper clipper;
+			const auto end = std::min(paths.size(), (batch + 1) * batchSize);
+			for (auto i = batch * batchSize; i < end; i++)
+				clipper.AddPath(paths[order[i].second], ClipperLib::ptSubject, true);
+			clipper.Execute(
+				ClipperLib::ctUnion,
+				parts[batch],
+				ClipperLib::pftNonZero,
+				ClipperLib::pftNonZero);
+		});
+
+	// neighbours in the curve order are merged, so merges stay local too
+	while (parts.size() > 2)
+	{
+		std::vector<ClipperLib::Paths> merged((parts.size() + 1) / 2);
+		Parallel::forEach(
+			merged.size(),
+			[&](size_t i)
+			{
+				if (2 * i + 1 == parts.size())
+				{
+					merged[i] = std::move(parts[2 * i]);
+					return;
+				}
+				ClipperLib::Clipper clipper;
+				clipper.AddPaths(parts[2 * i], ClipperLib::ptSubject, true);
+				clipper.AddPaths(parts[2 * i + 1], ClipperLib::ptSubject, true);
+				clipper.Execute(
+					ClipperLib::ctUnion,
+					merged[i],
+					ClipperLib::pftNonZero,
+					ClipperLib::pftNonZero);
+			});
+		parts.swap(merged);
+	}
+
+	paths.clear();
+	for (auto& part: parts)
+		for (auto& path: part)
+			paths.push_back(std::move(path));
+}
+
+
+Collection::~Collection()
+{
+	for (auto file: { indexSpill, meshSpill, colorSpill })
+		if (file)
+			fclose(file);
+}
+
+void Collection::stream(File::Pack& output)
+{
+	if (!meshes.empty() || vertexStream)
+		throw std::runtime_error("Collection::stream() must be called before adding meshes");
+
+	deduplicateMeshes = false;
+	vertexStream = output.addStream<float2>("vert", 20);
+}
+
+void Collection::openMesh()
+{
+	if (meshes.empty())
+		addMesh();
+	else if (finishedMeshes == meshes.size())
+		throw std::runtime_error("Paths added to a finished mesh, call addMesh() first");
+}
+
+void Collection::flush()
+{
+	TRACE_ZONE("collection/flush");
+
+	for (auto& v: vertices)
+		v.y = 1 - v.y;
+	vertexStream->write(vertices.data(), vertices.size() * sizeof(float2));
+	spill(indexSpill, indices);
+	spill(meshSpill, meshes);
+
+	if (colors == MeshColors::PerMesh)
+		spill(colorSpill, meshColors);
+	else if (colors == MeshColors::PerVertex)
+	{
+		std::vector<uint32_t> vertexColors(vertices.size());
+		for (size_t mesh = 0; mesh < meshes.size(); mesh++)
+		{
+			const auto end =
+				mesh + 1 < meshes.size() ? meshVertices[mesh + 1] : (int)vertices.size();
+			std::fill(
+				vertexColors.begin() + meshVertices[mesh],
+				vertexColors.begin() + end,
+				meshColors[mesh]);
+		}
+		spill(colorSpill, vertexColors);
+	}
+
+	flushedVertices += vertices.size();
+	flushedIndices += indices.size();
+	flushedMeshes += meshes.size();
+	TRACE_COUNT("vertices streamed", vertices.size());
+
+	vertices.clear();
+	indices.clear();
+	meshes.clear();
+	meshColors.clear();
+	meshVertices.clear();
+	finishedMeshes = 0;
+	meshVertex = 0;
+	startVertex = 0;
+}
+
+
+void Collection::tessellateIslands()
+{
+	if (pathBuffer.empty())
+		return;
+
+	ClipperLib::PolyTree tree;
+	{
+		TRACE_ZONE("union");
+		ClipperLib::Clipper clipper;
+		clipper.AddPaths(pathBuffer, ClipperLib::ptSubject, true);
+		if (!clipRect.empty())
+			clipper.AddPath(clipRect, ClipperLib::ptClip, true);
+		clipper.Execute(
+			clipRect.empty() ? ClipperLib::ctUnion : ClipperLib::ctIntersection,
+			tree,
+			ClipperLib::pftNonZero,
+			ClipperLib::pftNonZero);
+	}
+
+	// outer contours inside holes are islands of their own
+	std::vector<const ClipperLib::PolyNode*> islands;
+	size_t numPoints = 0;
+	for (auto node = tree.GetFirst(); node; node = node->GetNext())
+	{
+		numPoints += node->Contour.size();
+		if (!node->IsHole())
+			islands.push_back(node);
+	}
+	TRACE_COUNT("islands tessellated", islands.size());
+
+	struct Island
+	{
+		std::vector<float2> vertices;
+		std::vector<int> elements;
+	};
+	std::vector<Island> results(islands.size());
+	auto tessellate = [&](size_t index)
+	{
+		TRACE_ZONE("tessellate");
+
+		auto tess = newTesselator();
+		std::vector<float2> tessInput;
+		auto addContour = [&](const ClipperLib::Path& path)
+		{
+			tessInput.clear();
+			for (const auto& pt: path)
+				tessInput.push_back(toVertex(pt));
+			tessAddContour(tess, 2, tessInput.data(), sizeof(float2), tessInput.size());
+		};
+		addContour(islands[index]->Contour);
+		for (const auto hole: islands[index]->Childs)
+			addContour(hole->Contour);
+
+		if (tessTesselate(tess, TESS_WINDING_ODD, TESS_POLYGONS, 3, 2, nullptr))
+		{
+			auto& island = results[index];
+			const auto* tessVertices = (const float2*)tessGetVertices(tess);
+			island.vertices.assign(tessVertices, tessVertices + tessGetVertexCount(tess));
+			const auto* elem = tessGetElements(tess);
+			island.elements.assign(elem, elem + 3 * tessGetElementCount(tess));
+		}
+		tessDeleteTess(tess);
+	};
+
+	if (numPoints >= ISLAND_PARALLEL_POINTS && islands.size() > 1)
+		Parallel::forEach(islands.size(), tessellate);
+	else
+		for (size_t index = 0; index < islands.size(); index++)
+			tessellate(index);
+
+	// concatenated in tree order, so the output does not depend on the thread count
+	for (const auto& island: results)
+	{
+		const auto base = (uint32_t)(flushedVertices + vertices.size());
+		vertices.insert(vertices.end(), island.vertices.begin(), island.vertices.end());
+		for (const auto element: island.elements)
+			indices.push_back(element + base);
+		TRACE_COUNT("triangles emitted", island.elements.size() / 3);
+	}
+}
+
 void Collection::save(const std::filesystem::path& filename)
 {
+	File::Pack output(filename, 'w', "FNTMSH");
+	save(output);
+}
+
+void Collection::addStroke(const std::vector<float2>& points, bool closed, const Stroke& stroke)
+{
+	TRACE_ZONE("stroke");
+
+	openMesh();
+
+	// round joins and caps deviate at most 1% of the width from true arcs
+	const auto delta = stroke.width / 2 * pointScale;
+	ClipperLib::ClipperOffset offset(stroke.miterLimit, std::max(delta * 0.02, 0.25));
+	offset.AddPath(toPath(points), stroke.join, closed ? ClipperLib::etClosedLine : stroke.cap);
+
+	ClipperLib::Paths outline;
+	offset.Execute(outline, delta);
+	pathBuffer.insert(pathBuffer.end(), outline.begin(), outline.end());
+}
+
+void Collection::append(Collection& other)
+{
+	TRACE_ZONE("collection/append");
+
 	finishMesh();
+	other.finishMesh();
+	pathPoints += other.pathPoints;
+	keptPoints += other.keptPoints;
+
+	for (size_t mesh = 0; mesh < other.meshes.size(); mesh++)
+	{
+		const auto firstVertex = other.meshVertices[mesh];
+		const auto endVertex = mesh + 1 < other.meshes.size() ? other.meshVertices[mesh + 1]
+															  : (int)other.vertices.size();
+		const auto& source = other.meshes[mesh];
+
+		meshes.emplace_back(flushedIndices + indices.size(), source.indexCount);
+		meshColors.push_back(other.meshColors[mesh]);
+		meshVertex = (int)vertices.size();
+		meshVertices.push_back(meshVertex);
+
+		vertices.insert(
+			vertices.end(),
+			other.vertices.begin() + firstVertex,
+			other.vertices.begin() + endVertex);
+		const auto base = (uint32_t)(flushedVertices + meshVertex);
+		for (int i = 0; i < source.indexCount; i++)
+			indices.push_back(other.indices[source.startIndex + i] - firstVertex + base);
+
+		if (deduplicateMeshes)
+			shareDuplicate();
+		finishedMeshes = meshes.size();
+	}
+	startVertex = (int)vertices.size();
+
+	if (vertexStream && vertices.size() >= streamedVertices)
+		flush();
+}
+
+void Collection::save(File::Pack& output)
+{
+	TRACE_ZONE("collection/save");
+
+	finishMesh();
+
+	if (vertexStream)
+	{
+		flush();
+		vertexStream->finish();
+		vertexStream.reset();
+		unspill<uint32_t>(indexSpill, output, "idx");
+		unspill<Mesh>(meshSpill, output, "mesh");
+		if (colors == MeshColors::PerMesh)
+			unspill<uint32_t>(colorSpill, output, "color");
+		else if (colors == MeshColors::PerVertex)
+			unspill<uint32_t>(colorSpill, output, "vcolor");
+
+		printf(
+			"Collection '%s' with %zu meshes, %zu vertices, and %zu indices streamed.\n",
+			output.filename.stem().c_str(),
+			flushedMeshes,
+			flushedVertices,
+			flushedIndices);
+		printSimplification(pathPoints, keptPoints);
+		return;
+	}
 
 	for (auto& v: vertices)
 		v.y = 1 - v.y;
 
-	File::Pack output(filename, 'w', "FNTMSH");
 	output.add("vert", vertices, 20);
 	output.add("idx", indices, 20);
 	output.add("mesh", meshes, 20);
 
+	if (colors == MeshColors::PerMesh)
+		output.add("color", meshColors, 20);
+	else if (colors == MeshColors::PerVertex)
+	{
+		std::vector<uint32_t> vertexColors(vertices.size());
+		for (size_t mesh = 0; mesh < meshes.size(); mesh++)
+		{
+			const auto end =
+				mesh + 1 < meshes.size() ? meshVertices[mesh + 1] : (int)vertices.size();
+			std::fill(
+				vertexColors.begin() + meshVertices[mesh],
+				vertexColors.begin() + end,
+				meshColors[mesh]);
+		}
+		output.add("vcolor", vertexColors, 20);
+	}
+
 	printf(
 		"Collection '%s' with %zu meshes, %zu vertices, and %zu indices saved.\n",
-		filename.stem().c_str(),
+		output.filename.stem().c_str(),
 		meshes.size(),
 		vertices.size(),
 		indices.size());
+	printSimplification(pathPoints, keptPoints);
+	if (duplicateMeshes)
+		printf("  %zu duplicate meshes shared, %zu bytes saved\n", duplicateMeshes, bytesSaved);
+}
+
+void Collection::shareDuplicate()
+{
+	auto& mesh = meshes.back();
+	const MeshRange range {
+		mesh.startIndex,
+		mesh.indexCount,
+		meshVertex,
+		(int)vertices.size() - meshVertex,
+	};
+	if (range.indexCount == 0)
+		return;
+
+	// FNV-1a of the vertices and of the indices relative to the first one
+	uint64_t hash = 0xcbf2'9ce4'8422'2325;
+	auto add = [&hash](const void* data, size_t size)
+	{
+		for (size_t i = 0; i < size; i++)
+			hash = (hash ^ ((const uint8_t*)data)[i]) * 0x100'0000'01b3;
+	};
+	add(vertices.data() + range.firstVertex, range.vertexCount * sizeof(float2));
+	for (int i = 0; i < range.indexCount; i++)
+	{
+		const uint32_t index = indices[range.startIndex + i] - range.firstVertex;
+		add(&index, sizeof(index));
+	}
+
+	auto same = [&](const MeshRange& other)
+	{
+		if (other.indexCount != range.indexCount || other.vertexCount != range.vertexCount)
+			return false;
+		if (memcmp(
+				vertices.data() + other.firstVertex,
+				vertices.data() + range.firstVertex,
+				range.vertexCount * sizeof(float2)))
+			return false;
+		for (int i = 0; i < range.indexCount; i++)
+			if (indices[other.startIndex + i] - other.firstVertex
+				!= indices[range.startIndex + i] - range.firstVertex)
+				return false;
+		return true;
+	};
+
+	const auto candidates = uniqueMeshes.equal_range(hash);
+	for (auto it = candidates.first; it != candidates.second; ++it)
+		if (same(it->second))
+		{
+			bytesSaved += range.vertexCount * sizeof(float2) + range.indexCount * sizeof(uint32_t);
+			duplicateMeshes++;
+			TRACE_COUNT("duplicate meshes", 1);
+
+			vertices.resize(range.firstVertex);
+			indices.resize(range.startIndex);
+			startVertex = (int)vertices.size();
+			mesh = Mesh(it->second.startIndex, it->second.indexCount);
+			return;
+		}
+
+	uniqueMeshes.emplace(hash, range);
 }
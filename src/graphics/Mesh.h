@@ -1,13 +1,21 @@
 #pragma once
 
+#include "Simplify.h"
 #include "../utils/Math.h"
 #include "../utils/File.h"
+#include "../utils/Trace.h"
 #include <tesselator.h>
 #include <clipper.hpp>
+#include <algorithm>
+#include <unordered_map>
 
 
 #define OUTPUT_TRIANGLES 1
 #define APPLY_UNION 1
+#define DEDUPLICATE_MESHES 1  // identical meshes share one range of "idx"
+#define ISLAND_PARALLEL_POINTS 20'000  // points from which split islands use the Parallel pool
+#define UNION_BATCH_PATHS 64  // paths per batch of a hierarchical union
+#define HIERARCHICAL_UNION_PATHS 512  // fewer paths are faster in one union, see bench "union/"
 
 struct Mesh
 {
@@ -19,19 +27,176 @@ struct Mesh
 	Mesh(int startIndex, int indexCount) : startIndex(startIndex), indexCount(indexCount) {}
 };
 
+// Levels of detail of a font pack. "mesh" starts with the finest mesh of every glyph, so
+// readers that ignore levels of detail keep working. "lod" has one GlyphLOD per glyph,
+// pointing at its levels in "lodlevel", ordered from finest to coarsest.
+struct GlyphLOD
+{
+	int firstLevel;
+	int levelCount;
+};
+
+struct MeshLOD
+{
+	int mesh;        // index into "mesh"
+	float maxError;  // largest distance to the real outline, in em
+};
+
+// Composite glyphs of a font pack converted with FontOptions::instanceComposites keep an
+// empty mesh; "composite" has one GlyphInstances per glyph listing the simple glyphs to draw
+// in its place from "instance". Overlapping components are not merged.
+struct GlyphInstances
+{
+	int firstInstance;
+	int instanceCount;
+};
+
+struct MeshInstance
+{
+	int glyph;           // index into "mesh" and "lod"
+	float transform[6];  // x' = t[0] x + t[1] y + t[2], y' = t[3] x + t[4] y + t[5] on "vert"
+};
+
+// Variable font packs store, for every axis, the vertex deltas from the default instance to
+// the axis minimum and to its maximum in "vardelta": region 2 * axis is the minimum, region
+// 2 * axis + 1 the maximum, each with one delta per vertex of "vert". "varaxis" lists the
+// axes and "varinstance" the design coordinates of the named instances, one per axis each.
+struct VariationAxis
+{
+	uint32_t tag;
+	float minimum;
+	float defaultValue;
+	float maximum;
+};
+
+// Vertex of a variable font pack at the given design coordinates; exact at the default,
+// minimum and maximum of each axis, and interpolated linearly in between
+inline float2 varyVertex(
+	const std::vector<float2>& vertices,
+	const std::vector<float2>& deltas,
+	const std::vector<VariationAxis>& axes,
+	const float* coordinates,
+	size_t vertex)
+{
+	auto position = vertices[vertex];
+	for (size_t axis = 0; axis < axes.size(); axis++)
+	{
+		const auto& range = axes[axis];
+		const auto value = std::clamp(coordinates[axis], range.minimum, range.maximum);
+		if (value < range.defaultValue)
+			position += deltas[2 * axis * vertices.size() + vertex]
+						* ((range.defaultValue - value) / (range.defaultValue - range.minimum));
+		else if (value > range.defaultValue)
+			position += deltas[(2 * axis + 1) * vertices.size() + vertex]
+						* ((value - range.defaultValue) / (range.maximum - range.defaultValue));
+	}
+	return position;
+}
+
+// Mesh index of the coarsest level whose error stays within maxPixelError at pixelsPerEm
+inline int selectLOD(
+	const GlyphLOD& glyph,
+	const MeshLOD* levels,
+	float pixelsPerEm,
+	float maxPixelError = 0.5f)
+{
+	const auto* finest = levels + glyph.firstLevel;
+	for (int level = glyph.levelCount - 1; level > 0; level--)
+		if (finest[level].maxError * pixelsPerEm <= maxPixelError)
+			return finest[level].mesh;
+	return finest[0].mesh;
+}
+
+// Tiled SVG packs (SVGOptions::tileSize) cut every shape along a grid and keep the meshes of
+// each tile together in "mesh", in document order. "tile" has one MeshTile per tile with
+// meshes, row by row from the top, so renderers can draw only the tiles in view.
+struct MeshTile
+{
+	int firstMesh;
+	int meshCount;
+	float minX, minY, maxX, maxY;  // bounds in the coordinates of "vert"
+};
+
+// Replace `paths` with the union of spatially sorted batches of `batchSize` of them, merged in
+// pairs on the Parallel pool until two partial unions are left. That covers the same area with
+// the nonzero rule, so the union of the result is the union of `paths`, computed faster when
+// there are many of them.
+void unionBatches(ClipperLib::Paths& paths, size_t batchSize = UNION_BATCH_PATHS);
+
+// Outline of a line along a path, widths in the units of the path
+struct Stroke
+{
+	float width = 1;
+	ClipperLib::JoinType join = ClipperLib::jtMiter;
+	ClipperLib::EndType cap = ClipperLib::etOpenButt;  // closed paths have no caps
+	float miterLimit = 4;                               // in multiples of width / 2
+};
+
+// Colors are RGBA8 with red in the lowest byte, opacity already applied to alpha
+enum class MeshColors
+{
+	None,
+	PerMesh,    // "color": one per entry of "mesh"
+	PerVertex,  // "vcolor": one per vertex, so "idx" can be drawn in one call in painter's
+				// order; meshes are never shared then
+};
+
 class Collection
 {
 public:
-	Collection()
+	Collection(bool deduplicateMeshes = DEDUPLICATE_MESHES, MeshColors colors = MeshColors::None)
+		: deduplicateMeshes(deduplicateMeshes && colors != MeshColors::PerVertex),
+		  colors(colors)
 	{
 		vertices.reserve(1000);
 		indices.reserve(6000);
 	}
+	~Collection();
+
+	// Write finished meshes to `output` as the collection grows instead of keeping them until
+	// save(output), which must still be called to complete the pack. Memory then stays bounded
+	// whatever the number of meshes; meshes are not shared and the getters only return what
+	// has not been written yet. Call before adding anything.
+	void stream(File::Pack& output);
+
+	// Points given to addPath are rounded to pointScale units in 64-bit Clipper coordinates
+	// and stay integers through union; libtess2 gets them multiplied by vertexScale, the only
+	// conversion back to floats. Callers with integer coordinates (font units) can pick
+	// scales that keep them exact. Defaults to 1e-5 units.
+	void setScale(double pointScale, double vertexScale)
+	{
+		this->pointScale = pointScale;
+		this->vertexScale = vertexScale;
+	}
+
+	// Tessellate every island of a mesh, an outer contour of the union with its holes, on its
+	// own instead of sweeping all of them at once, which costs more than linearly in the
+	// number of points. The triangles are the same up to their order and the vertices of
+	// points where islands touch. Needs APPLY_UNION and OUTPUT_TRIANGLES.
+	void setSplitIslands(bool splitIslands) { this->splitIslands = splitIslands; }
+
+	// Union meshes with at least HIERARCHICAL_UNION_PATHS paths hierarchically, see
+	// unionBatches. Intersections may round differently than in a single union.
+	void setHierarchicalUnion(bool hierarchicalUnion)
+	{
+		this->hierarchicalUnion = hierarchicalUnion;
+	}
+
+	// Cut the meshes finished from now on to the rectangle from `min` to `max`, in the units
+	// of addPath, as part of their union. Call after setScale(). Needs APPLY_UNION.
+	void setClip(float2 min, float2 max)
+	{
+		clipRect = toPath({ min, float2(max.x, min.y), max, float2(min.x, max.y) });
+	}
 
 	void addMesh(uint32_t color = 0xff00'0000, float opacity = 1.0f)
 	{
 		finishMesh();
-		meshes.emplace_back(indices.size());
+		if (vertexStream && vertices.size() >= streamedVertices)
+			flush();
+		meshes.emplace_back(flushedIndices + indices.size());
+		meshVertex = (int)vertices.size();
+		meshVertices.push_back(meshVertex);
 
 		const auto r = (color >> 0) & 0xff;
 		const auto g = (color >> 8) & 0xff;
@@ -39,39 +204,100 @@ public:
 		const auto a = (color >> 24) & 0xff;
 
 		const auto alpha = (int)(a * opacity);
+		meshColors.push_back(r | (g << 8) | (b << 16) | (alpha << 24));
 
 		startVertex = (int)vertices.size();
 	}
 
-	void addPath(const std::vector<float2>& points)
+	// Adds a filled path to the current mesh, simplified first when given a tolerance (see
+	// simplifyPath) since union and tessellation cost grows with the number of points
+	void addPath(const std::vector<float2>& points, float tolerance = 0)
 	{
-		ClipperLib::Path path;
-		for (const auto& p: points)
+		openMesh();
+		pathPoints += points.size();
+		if (tolerance > 0)
 		{
-			path << ClipperLib::IntPoint(
-				static_cast<int>(p.x * 100'000),
-				static_cast<int>(p.y * 100'000));
+			simplifyPath(points, tolerance, simplified);
+			pathBuffer.push_back(toPath(simplified));
+			keptPoints += simplified.size();
+		}
+		else
+		{
+			pathBuffer.push_back(toPath(points));
+			keptPoints += points.size();
 		}
-		pathBuffer.push_back(path);
-
-		if (meshes.empty())
-			addMesh();
 	}
 
+	// Adds the area covered by a stroke along points to the current mesh; it goes through
+	// the same union and tessellation as filled paths
+	void addStroke(const std::vector<float2>& points, bool closed, const Stroke& stroke);
+
+	// Move the meshes of `other` to the end of this collection, in order. The result is the
+	// same as adding their paths here; `other` should not share meshes itself.
+	void append(Collection& other);
+
+	// finish the last mesh and return the result, as it is before save() flips y. The last
+	// mesh stays finished: call addMesh() before adding more paths, addPath and addStroke
+	// throw otherwise. The same goes after append().
+	const std::vector<float2>& getVertices() { return finishMesh(), vertices; }
+	const std::vector<uint32_t>& getIndices() { return finishMesh(), indices; }
+	const std::vector<Mesh>& getMeshes() { return finishMesh(), meshes; }
+
 	void save(const std::filesystem::path& filename);
+	// writes "vert", "idx" and "mesh", the caller may add more blocks to the same pack
+	void save(File::Pack& output);
 
 private:
+	ClipperLib::Path toPath(const std::vector<float2>& points) const
+	{
+		ClipperLib::Path path;
+		path.reserve(points.size());
+		for (const auto& p: points)
+			path.emplace_back(llround(p.x * pointScale), llround(p.y * pointScale));
+		return path;
+	}
+
+	float2 toVertex(const ClipperLib::IntPoint& point) const
+	{
+		return { float(point.X * vertexScale), float(point.Y * vertexScale) };
+	}
+
 	void finishMesh()
+	{
+		if (hierarchicalUnion && APPLY_UNION && pathBuffer.size() >= HIERARCHICAL_UNION_PATHS)
+			unionBatches(pathBuffer);
+
+		if (splitIslands && APPLY_UNION && OUTPUT_TRIANGLES)
+			tessellateIslands();
+		else
+			tessellate();
+
+		pathBuffer.clear();  // Clear the path buffer after union
+
+		if (meshes.size() > finishedMeshes)
+		{
+			meshes.back().indexCount = flushedIndices + indices.size() - meshes.back().startIndex;
+			if (deduplicateMeshes)
+				shareDuplicate();
+			finishedMeshes = meshes.size();
+		}
+	}
+
+	// Union of the path buffer tessellated in one sweep, added to the current mesh
+	void tessellate()
 	{
 		ClipperLib::Paths solution;
 		if (!pathBuffer.empty())
 		{
+			TRACE_ZONE("union");
 			ClipperLib::Clipper clipper;
 			clipper.AddPaths(pathBuffer, ClipperLib::ptSubject, true);
+			if (!clipRect.empty())
+				clipper.AddPath(clipRect, ClipperLib::ptClip, true);
 			if (APPLY_UNION)
 			{
 				clipper.Execute(
-					ClipperLib::ctUnion,
+					clipRect.empty() ? ClipperLib::ctUnion : ClipperLib::ctIntersection,
 					solution,
 					ClipperLib::pftNonZero,
 					ClipperLib::pftNonZero);
@@ -84,22 +310,21 @@ private:
 
 		if (OUTPUT_TRIANGLES)
 		{
+			TRACE_ZONE("tessellate");
+
 			// Convert Clipper solution to libtess2 input
-			tess = tessNewTess(nullptr);
+			tess = newTesselator();
 			for (const auto& path: solution)
 			{
 				std::vector<float2> tessInput;
 				for (const auto& pt: path)
-				{
-					tessInput.push_back(
-						{ static_cast<float>(pt.X) / 100000.0f,
-						  static_cast<float>(pt.Y) / 100000.0f });
-				}
+					tessInput.push_back(toVertex(pt));
 				tessAddContour(tess, 2, tessInput.data(), sizeof(float2), tessInput.size());
 			}
 
 			if (tessTesselate(tess, TESS_WINDING_ODD, TESS_POLYGONS, 3, 2, nullptr))
 			{
+				const auto base = (uint32_t)(flushedVertices + startVertex);
 				auto* tessVertices = (float2*)tessGetVertices(tess);
 				int numVertices = tessGetVertexCount(tess);
 				copy_n(tessVertices, numVertices, back_inserter(vertices));
@@ -107,7 +332,9 @@ private:
 				const auto* elem = tessGetElements(tess);
 				int numIndices = 3 * tessGetElementCount(tess);
 				for (int i = 0; i < numIndices; i++)
-					indices.push_back(elem[i] + startVertex);
+					indices.push_back(elem[i] + base);
+
+				TRACE_COUNT("triangles emitted", numIndices / 3);
 			}
 
 			tessDeleteTess(tess);
@@ -120,17 +347,13 @@ private:
 			{
 				points.clear();
 				for (const auto& pt: path)
-				{
-					points.push_back(
-						{ static_cast<float>(pt.X) / 100000.0f,
-						  static_cast<float>(pt.Y) / 100000.0f });
-				}
+					points.push_back(toVertex(pt));
 
 				for (size_t i = 0; i < points.size(); ++i)
 				{
-					indices.push_back(startVertex + i);  // Index of current vertex
-					indices.push_back(startVertex + (i + 1) % points.size());  // Index of next
-																			   // vertex
+					const auto base = flushedVertices + startVertex;
+					indices.push_back(base + i);                        // Index of current vertex
+					indices.push_back(base + (i + 1) % points.size());  // Index of next vertex
 				}
 
 				for (size_t i = 0; i < points.size(); ++i)
@@ -140,19 +363,81 @@ private:
 				// cout << "points count: " << points.size() << endl;
 			}
 		}
+	}
 
-		pathBuffer.clear();  // Clear the path buffer after union
+	// Same as tessellate() an island at a time, on the Parallel pool for large meshes
+	void tessellateIslands();
 
-		if (!meshes.empty())
-			meshes.back().indexCount = indices.size() - meshes.back().startIndex;
+	static TESStesselator* newTesselator()
+	{
+#if defined(ENABLE_MEMORY_STATS)
+		TESSalloc allocator {};  // default bucket sizes
+		allocator.memalloc = [](void*, unsigned int size) { return Memory::allocate(size); };
+		allocator.memrealloc = [](void*, void* ptr, unsigned int size)
+		{
+			return Memory::reallocate(ptr, size);
+		};
+		allocator.memfree = [](void*, void* ptr) { Memory::release(ptr); };
+		return tessNewTess(&allocator);
+#else
+		return tessNewTess(nullptr);
+#endif
 	}
 
+	// Start the first mesh, or check that the last one was not finished by a getter or
+	// append(), since its union and index count are final by then
+	void openMesh();
+
+	// Point the last mesh at an identical earlier one and drop its own copy
+	void shareDuplicate();
+
+	// Write the finished meshes out when streaming and start over with empty buffers
+	void flush();
+
+	struct MeshRange
+	{
+		int startIndex;
+		int indexCount;
+		int firstVertex;
+		int vertexCount;
+	};
+
+	bool deduplicateMeshes;
+	bool splitIslands = false;
+	bool hierarchicalUnion = false;
+	double pointScale = 100'000;
+	double vertexScale = 1 / 100'000.0;
+	const MeshColors colors;
+	std::vector<uint32_t> meshColors;
+
+	std::unordered_multimap<uint64_t, MeshRange> uniqueMeshes;
+	size_t finishedMeshes = 0;
+	size_t duplicateMeshes = 0;
+	size_t bytesSaved = 0;
+
+	std::vector<int> meshVertices;  // first vertex of every mesh
+	int meshVertex = 0;             // and of the last one
 	int startVertex = 0;
 	TESStesselator* tess = nullptr;
 
+	// streaming: "vert" goes straight into the pack, the other blocks into temporary files
+	// until save(); counts are of what was flushed so far
+	static constexpr size_t streamedVertices = 1 << 16;
+	std::unique_ptr<File::Pack::Stream> vertexStream;
+	FILE* indexSpill = nullptr;
+	FILE* meshSpill = nullptr;
+	FILE* colorSpill = nullptr;
+	size_t flushedVertices = 0;
+	size_t flushedIndices = 0;
+	size_t flushedMeshes = 0;
+
 	std::vector<float2> vertices;
 	std::vector<uint32_t> indices;
 	std::vector<Mesh> meshes;
 
 	ClipperLib::Paths pathBuffer;
+	ClipperLib::Path clipRect;  // empty without setClip()
+	std::vector<float2> simplified;
+	size_t pathPoints = 0;  // given to addPath
+	size_t keptPoints = 0;  // left after simplification
 };
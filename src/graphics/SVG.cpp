@@ -1,4 +1,7 @@
+#include "SVG.h"
 #include "Mesh.h"
+#include "../utils/Parallel.h"
+#include <cfloat>
 
 #define NANOSVG_IMPLEMENTATION
 #include <nanosvg.h>
@@ -6,30 +9,105 @@
 using namespace std;
 
 
-void saveSVG(const filesystem::path& filename)
+namespace
 {
-	auto image = nsvgParseFromFile(filename.c_str(), "px", 96.0f);
-	if (!image)
-		throw runtime_error("Could not open SVG image.");
+	constexpr size_t shapesPerTask = 16;
+	constexpr size_t tilesPerBatch = 64;  // tiles kept in memory at once when tiling
+	constexpr size_t streamedChunk = 1 << 20;  // bytes of SVG parsed at once when streaming
 
-	printf("SVG image with size %f x %f\n", image->width, image->height);
+	bool painted(const NSVGpaint& paint)
+	{
+		return paint.type == NSVG_PAINT_COLOR || paint.type == NSVG_PAINT_LINEAR_GRADIENT
+			   || paint.type == NSVG_PAINT_RADIAL_GRADIENT;
+	}
+
+	// Meshes have a single color, gradients get their first stop
+	uint32_t paintColor(const NSVGpaint& paint)
+	{
+		if (paint.type == NSVG_PAINT_COLOR)
+			return paint.color;
+		if (painted(paint) && paint.gradient->nstops > 0)
+			return paint.gradient->stops[0].color;
+		return 0;
+	}
 
-	Collection output;
-	vector<float2> points;
+	bool stroked(const NSVGshape* shape, const SVGOptions& options)
+	{
+		return options.strokes && painted(shape->stroke) && shape->strokeWidth > 0;
+	}
 
-	for (auto shape = image->shapes; shape != NULL; shape = shape->next)
+	void printShape(const NSVGshape* shape)
 	{
-		output.addMesh(shape->fill.color, shape->opacity);
 		printf(
 			"Shape '%s'  fill %08x  stroke %08x  opacity %f\n",
 			shape->id,
-			shape->fill.color,
-			shape->stroke.color,
+			paintColor(shape->fill),
+			paintColor(shape->stroke),
 			shape->opacity);
+	}
+
+	void configure(Collection& output, const SVGOptions& options)
+	{
+		output.setSplitIslands(options.splitIslands);
+		output.setHierarchicalUnion(options.hierarchicalUnion);
+	}
+
+	Stroke strokeStyle(const NSVGshape* shape)
+	{
+		Stroke stroke;
+		stroke.width = shape->strokeWidth;
+		stroke.miterLimit = shape->miterLimit;
+		stroke.join = shape->strokeLineJoin == NSVG_JOIN_ROUND ? ClipperLib::jtRound
+					  : shape->strokeLineJoin == NSVG_JOIN_BEVEL
+						  ? ClipperLib::jtSquare  // closest Clipper has
+						  : ClipperLib::jtMiter;
+		stroke.cap = shape->strokeLineCap == NSVG_CAP_ROUND    ? ClipperLib::etOpenRound
+					 : shape->strokeLineCap == NSVG_CAP_SQUARE ? ClipperLib::etOpenSquare
+															   : ClipperLib::etOpenButt;
+		return stroke;
+	}
+
+	// how far strokes of the shape may reach out of its bounds
+	float strokeMargin(const NSVGshape* shape, const SVGOptions& options)
+	{
+		if (!stroked(shape, options))
+			return 0;
+		return shape->strokeWidth / 2 * max(shape->miterLimit, 1.0f);
+	}
 
-		for (auto path = shape->paths; path != NULL; path = path->next)
+	bool overlaps(const float* bounds, const float* tile, float margin)
+	{
+		return bounds[0] - margin < tile[2] && bounds[2] + margin > tile[0]
+			   && bounds[1] - margin < tile[3] && bounds[3] + margin > tile[1];
+	}
+
+	// A mesh for the fill of the shape unless it has none, then one for its stroke if asked
+	// for. With `tile` (min x, min y, max x, max y), paths that cannot reach it are left out.
+	void addShape(
+		Collection& output,
+		const NSVGshape* shape,
+		vector<vector<float2>>& paths,
+		const SVGOptions& options,
+		const float* tile = nullptr)
+	{
+		TRACE_ZONE("svg/shape");
+		TRACE_COUNT("shapes processed", 1);
+
+		const bool filled = painted(shape->fill);
+		if (!filled && !stroked(shape, options))
+			return;
+		if (filled)
+			output.addMesh(paintColor(shape->fill), shape->opacity);
+
+		size_t numPaths = 0;
+		for (auto path = shape->paths; path != NULL; path = path->next, numPaths++)
 		{
+			if (paths.size() == numPaths)
+				paths.emplace_back();
+			auto& points = paths[numPaths];
 			points.clear();
+			if (tile && !overlaps(path->bounds, tile, strokeMargin(shape, options)))
+				continue;
 			// printf(
 			// 	"    Path with %d points, closed=%d, bounds %f %f %f %f\n",
 			// 	path->npts,
@@ -75,12 +153,307 @@ void saveSVG(const filesystem::path& filename)
 				}
 			}
 
-			output.addPath(points);
+			TRACE_COUNT("points flattened", points.size());
+			if (filled && (!tile || overlaps(path->bounds, tile, 0)))
+				output.addPath(points, options.simplifyTolerance);
+		}
+
+		if (!stroked(shape, options))
+			return;
+
+		output.addMesh(paintColor(shape->stroke), shape->opacity);
+		const auto stroke = strokeStyle(shape);
+		auto path = shape->paths;
+		for (size_t i = 0; i < numPaths; i++, path = path->next)
+		{
+			// straight segments only add their end point, open paths need the start too
+			auto& points = paths[i];
+			if (tile && !overlaps(path->bounds, tile, strokeMargin(shape, options)))
+				continue;
+			const float2 start(path->pts[0], path->pts[1]);
+			if (points.empty() || points.front() != start)
+				points.insert(points.begin(), start);
+			output.addStroke(points, path->closed, stroke);
+		}
+	}
+
+	// Convert shapes in document order, on the Parallel pool if asked to
+	void addShapes(
+		Collection& output,
+		const vector<const NSVGshape*>& shapes,
+		const SVGOptions& options,
+		MeshColors colors)
+	{
+		if (options.parallel)
+		{
+			// groups are tessellated without sharing meshes, append() deduplicates in order
+			const auto numGroups = (shapes.size() + shapesPerTask - 1) / shapesPerTask;
+			vector<unique_ptr<Collection>> groups(numGroups);
+			Parallel::forEach(
+				numGroups,
+				[&](size_t group)
+				{
+					groups[group] = make_unique<Collection>(false, colors);
+					configure(*groups[group], options);
+					vector<vector<float2>> paths;
+					const auto end = min(shapes.size(), (group + 1) * shapesPerTask);
+					for (auto i = group * shapesPerTask; i < end; i++)
+						addShape(*groups[group], shapes[i], paths, options);
+				});
+
+			for (size_t group = 0; group < numGroups; group++)
+			{
+				const auto end = min(shapes.size(), (group + 1) * shapesPerTask);
+				for (auto i = group * shapesPerTask; i < end; i++)
+					printShape(shapes[i]);
+				output.append(*groups[group]);
+				groups[group].reset();
+			}
+		}
+		else
+		{
+			vector<vector<float2>> paths;
+			for (auto shape: shapes)
+			{
+				printShape(shape);
+				addShape(output, shape, paths, options);
+			}
+		}
+	}
+
+	// Convert shapes cut along a grid of options.tileSize, a batch of tiles at a time on the
+	// Parallel pool, and return the tiles that got meshes. Every tile only gets the shapes,
+	// and the paths of them, whose bounds reach it.
+	vector<MeshTile> addTiles(
+		Collection& output,
+		const vector<const NSVGshape*>& shapes,
+		const SVGOptions& options,
+		MeshColors colors)
+	{
+		TRACE_ZONE("svg/tiles");
+
+		const auto size = options.tileSize;
+		float bounds[4] = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (auto shape: shapes)
+		{
+			const auto margin = strokeMargin(shape, options);
+			bounds[0] = min(bounds[0], shape->bounds[0] - margin);
+			bounds[1] = min(bounds[1], shape->bounds[1] - margin);
+			bounds[2] = max(bounds[2], shape->bounds[2] + margin);
+			bounds[3] = max(bounds[3], shape->bounds[3] + margin);
+		}
+		if (shapes.empty())
+			return {};
+
+		const auto firstColumn = (int)floor(bounds[0] / size);
+		const auto firstRow = (int)floor(bounds[1] / size);
+		const auto columns = max(1, (int)ceil(bounds[2] / size) - firstColumn);
+		const auto rows = max(1, (int)ceil(bounds[3] / size) - firstRow);
+		auto tileBounds = [&](size_t tile, float* rect)
+		{
+			rect[0] = (firstColumn + int(tile % columns)) * size;
+			rect[1] = (firstRow + int(tile / columns)) * size;
+			rect[2] = rect[0] + size;
+			rect[3] = rect[1] + size;
+		};
+
+		// shapes with a path reaching every tile, in document order
+		auto cell = [&](float position, int first, int count)
+		{ return clamp((int)floor(position / size) - first, 0, count - 1); };
+		vector<vector<uint32_t>> tileShapes((size_t)columns * rows);
+		for (uint32_t i = 0; i < shapes.size(); i++)
+		{
+			const auto margin = strokeMargin(shapes[i], options);
+			for (auto path = shapes[i]->paths; path != NULL; path = path->next)
+			{
+				const auto* b = path->bounds;
+				const auto left = cell(b[0] - margin, firstColumn, columns);
+				const auto top = cell(b[1] - margin, firstRow, rows);
+				const auto right = cell(b[2] + margin, firstColumn, columns);
+				const auto bottom = cell(b[3] + margin, firstRow, rows);
+				for (int row = top; row <= bottom; row++)
+					for (int column = left; column <= right; column++)
+					{
+						auto& list = tileShapes[(size_t)row * columns + column];
+						if (list.empty() || list.back() != i)
+							list.push_back(i);
+					}
+			}
+		}
+		vector<size_t> used;
+		for (size_t tile = 0; tile < tileShapes.size(); tile++)
+			if (!tileShapes[tile].empty())
+				used.push_back(tile);
+
+		vector<MeshTile> tiles;
+		for (size_t first = 0; first < used.size(); first += tilesPerBatch)
+		{
+			const auto count = min(tilesPerBatch, used.size() - first);
+			vector<unique_ptr<Collection>> batch(count);
+			Parallel::forEach(
+				count,
+				[&](size_t i)
+				{
+					float rect[4];
+					tileBounds(used[first + i], rect);
+					auto& tile = batch[i] = make_unique<Collection>(false, colors);
+					configure(*tile, options);
+					tile->setClip(float2(rect[0], rect[1]), float2(rect[2], rect[3]));
+					vector<vector<float2>> paths;
+					for (auto shape: tileShapes[used[first + i]])
+						addShape(*tile, shapes[shape], paths, options, rect);
+				});
+
+			for (size_t i = 0; i < count; i++)
+			{
+				float rect[4];
+				tileBounds(used[first + i], rect);
+				const auto firstMesh = (int)output.getMeshes().size();
+				output.append(*batch[i]);
+				batch[i].reset();
+
+				// save() flips y
+				const auto meshCount = (int)output.getMeshes().size() - firstMesh;
+				tiles.push_back(
+					{ firstMesh, meshCount, rect[0], 1 - rect[3], rect[2], 1 - rect[1] });
+			}
 		}
+		return tiles;
 	}
 
+	// Parse a mapping of the file a chunk at a time with one nanosvg parser, converting and
+	// freeing the shapes of each chunk before going on. Chunks end right after a tag, where
+	// nanosvg's own scanner would end it, so elements and text are never split.
+	void streamShapes(
+		Collection& output,
+		const filesystem::path& filename,
+		const SVGOptions& options,
+		MeshColors colors)
+	{
+		File::Mapping file(filename);
+		const auto data = (const char*)file.data();
+
+		auto parser = nsvg__createParser();
+		if (!parser)
+			throw runtime_error("Could not create SVG parser.");
+		parser->dpi = 96.0f;
+
+		vector<char> chunk;
+		vector<const NSVGshape*> shapes;
+		auto parse = [&](size_t begin, size_t end)
+		{
+			{
+				TRACE_ZONE("svg/parse");
+				chunk.assign(data + begin, data + end);
+				chunk.push_back('\0');
+				nsvg__parseXML(
+					chunk.data(),
+					nsvg__startElement,
+					nsvg__endElement,
+					nsvg__content,
+					parser);
+				nsvg__createGradients(parser);
+				nsvg__scaleToViewbox(parser, "px");
+			}
+
+			shapes.clear();
+			for (auto shape = parser->image->shapes; shape != NULL; shape = shape->next)
+				shapes.push_back(shape);
+			addShapes(output, shapes, options, colors);
+
+			for (auto shape = parser->image->shapes; shape != NULL;)
+			{
+				auto next = shape->next;
+				nsvg__deletePaths(shape->paths);
+				nsvg__deletePaint(&shape->fill);
+				nsvg__deletePaint(&shape->stroke);
+				free(shape);
+				shape = next;
+			}
+			parser->image->shapes = NULL;
+			parser->shapesTail = NULL;
+		};
+
+		bool inTag = false;
+		size_t begin = 0;
+		for (size_t i = 0; i < file.size(); i++)
+		{
+			if (data[i] == '<' && !inTag)
+				inTag = true;
+			else if (data[i] == '>' && inTag)
+			{
+				inTag = false;
+				if (i + 1 - begin >= streamedChunk)
+				{
+					parse(begin, i + 1);
+					begin = i + 1;
+				}
+			}
+		}
+		parse(begin, file.size());
+
+		printf("SVG image with size %f x %f\n", parser->image->width, parser->image->height);
+		nsvg__deleteParser(parser);
+	}
+}
+
+
+void saveSVG(const filesystem::path& filename, const SVGOptions& options)
+{
+	TRACE_ZONE("svg");
+
+	const auto colors = options.vertexColors ? MeshColors::PerVertex : MeshColors::PerMesh;
 	auto file = filename;
-	output.save(file.replace_extension(".mesh"));
+	file.replace_extension(".mesh");
+
+	if (options.streaming)
+	{
+		File::Pack pack(file, 'w', "FNTMSH");
+		Collection output(false, colors);
+		configure(output, options);
+		output.stream(pack);
+		streamShapes(output, filename, options, colors);
+		output.save(pack);
+
+		MEMORY_REPORT(filename.filename().u8string().c_str());
+		return;
+	}
+
+	NSVGimage* image = nullptr;
+	{
+		TRACE_ZONE("svg/parse");
+		image = nsvgParseFromFile(filename.c_str(), "px", 96.0f);
+	}
+	if (!image)
+		throw runtime_error("Could not open SVG image.");
+
+	printf("SVG image with size %f x %f\n", image->width, image->height);
+
+	Collection output(DEDUPLICATE_MESHES, colors);
+	configure(output, options);
+
+	vector<const NSVGshape*> shapes;
+	for (auto shape = image->shapes; shape != NULL; shape = shape->next)
+		shapes.push_back(shape);
+
+	if (options.tileSize > 0)
+	{
+		for (auto shape: shapes)
+			printShape(shape);
+		const auto tiles = addTiles(output, shapes, options, colors);
+
+		File::Pack pack(file, 'w', "FNTMSH");
+		output.save(pack);
+		pack.add("tile", tiles, 20);
+		printf("%zu tiles of %g pixels\n", tiles.size(), options.tileSize);
+	}
+	else
+	{
+		addShapes(output, shapes, options, colors);
+		output.save(file);
+	}
 
 	nsvgDelete(image);
+
+	MEMORY_REPORT(filename.filename().u8string().c_str());
 }
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <filesystem>
+
+
+struct SVGOptions
+{
+	// tessellate groups of shapes concurrently on the Parallel pool and merge them in
+	// document order; the output is the same as converting them one after another
+	bool parallel = false;
+
+	// store fill colors per vertex instead of per mesh, see MeshColors
+	bool vertexColors = false;
+
+	// add a mesh for the stroke of every stroked shape, after its fill; dashes are ignored
+	bool strokes = false;
+
+	// parse the file a chunk at a time, converting and freeing the shapes of each chunk
+	// right away and writing meshes to the pack as they are made, so memory stays bounded
+	// for very large documents. Gradients must be defined before they are used, and
+	// documents without a size or viewBox are scaled by the bounds of their first chunk.
+	bool streaming = false;
+
+	// largest distance in pixels that path simplification may move a fill, 0 keeps every
+	// flattened point
+	float simplifyTolerance = 0.05f;
+
+	// tessellate the islands of every shape separately, see Collection::setSplitIslands;
+	// worth it for shapes made of many disjoint parts
+	bool splitIslands = false;
+
+	// union shapes made of thousands of paths (hatching, stipples) in parallel batches, see
+	// Collection::setHierarchicalUnion
+	bool hierarchicalUnion = false;
+
+	// cut shapes along a grid of square tiles this many pixels wide and tessellate the tiles
+	// on the Parallel pool, writing one mesh per shape and tile and the "tile" block (see
+	// MeshTile). 0 converts whole shapes. Not used when streaming.
+	float tileSize = 0;
+};
+
+// Converts an SVG image to a mesh pack next to it, with one mesh per filled shape
+void saveSVG(const std::filesystem::path& filename, const SVGOptions& options = {});
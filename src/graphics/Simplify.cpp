@@ -0,0 +1,195 @@
+#include "Simplify.h"
+#include "../utils/Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#	include <emmintrin.h>
+#	define SIMPLIFY_SSE 1
+#else
+#	define SIMPLIFY_SSE 0
+#endif
+
+using namespace std;
+
+
+namespace
+{
+	// squared distance from a + d to the segment a-b, with ab = b - a
+	inline float distanceSquared(float2 d, float2 ab, float inverseLength)
+	{
+		const auto t = min(max((d.x * ab.x + d.y * ab.y) * inverseLength, 0.0f), 1.0f);
+		const auto x = d.x - ab.x * t;
+		const auto y = d.y - ab.y * t;
+		return x * x + y * y;
+	}
+
+	inline float inverse(float2 ab)
+	{
+		const auto lengthSquared = dot(ab, ab);
+		return lengthSquared > 0 ? 1 / lengthSquared : 0.0f;
+	}
+
+	// The point strictly between first and last farthest from the segment joining them, and
+	// its squared distance. The SSE loop does the same arithmetic four points at a time, so
+	// both give the same result.
+	pair<size_t, float> farthest(const float2* points, size_t first, size_t last)
+	{
+		const auto a = points[first];
+		const auto ab = points[last] - a;
+		const auto inverseLength = inverse(ab);
+
+		size_t index = first;
+		float distance = -1;
+		size_t i = first + 1;
+
+#if SIMPLIFY_SSE
+		const auto ax = _mm_set1_ps(a.x);
+		const auto ay = _mm_set1_ps(a.y);
+		const auto abx = _mm_set1_ps(ab.x);
+		const auto aby = _mm_set1_ps(ab.y);
+		const auto inv = _mm_set1_ps(inverseLength);
+		const auto zero = _mm_setzero_ps();
+		const auto one = _mm_set1_ps(1.0f);
+		for (; i + 4 <= last; i += 4)
+		{
+			const auto p01 = _mm_loadu_ps(&points[i].x);
+			const auto p23 = _mm_loadu_ps(&points[i + 2].x);
+			const auto x = _mm_sub_ps(_mm_shuffle_ps(p01, p23, _MM_SHUFFLE(2, 0, 2, 0)), ax);
+			const auto y = _mm_sub_ps(_mm_shuffle_ps(p01, p23, _MM_SHUFFLE(3, 1, 3, 1)), ay);
+
+			auto t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(x, abx), _mm_mul_ps(y, aby)), inv);
+			t = _mm_min_ps(_mm_max_ps(t, zero), one);
+			const auto dx = _mm_sub_ps(x, _mm_mul_ps(abx, t));
+			const auto dy = _mm_sub_ps(y, _mm_mul_ps(aby, t));
+			const auto d = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+			// only look at the lanes when one of them beats the best so far
+			auto highest = _mm_max_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+			highest = _mm_max_ps(
+				highest,
+				_mm_shuffle_ps(highest, highest, _MM_SHUFFLE(2, 3, 0, 1)));
+			if (_mm_cvtss_f32(highest) > distance)
+			{
+				alignas(16) float lanes[4];
+				_mm_store_ps(lanes, d);
+				for (int lane = 0; lane < 4; lane++)
+					if (lanes[lane] > distance)
+					{
+						distance = lanes[lane];
+						index = i + lane;
+					}
+			}
+		}
+#endif
+
+		for (; i < last; i++)
+		{
+			const auto d = distanceSquared(points[i] - a, ab, inverseLength);
+			if (d > distance)
+			{
+				distance = d;
+				index = i;
+			}
+		}
+		return { index, distance };
+	}
+}
+
+
+void simplifyPath(const vector<float2>& points, float tolerance, vector<float2>& output)
+{
+	TRACE_ZONE("simplify");
+
+	// Repeated points, and runs of points that all stay within `drift` of the segment from
+	// the point before the run to its last point. Every point of a run narrows a wedge of
+	// directions from that anchor, those of the lines passing within `drift` of it; the run
+	// grows while the next point is inside the wedge and no closer to the anchor than the
+	// points before it. Douglas-Peucker gets what is left of the tolerance.
+	const auto drift = tolerance / 16;
+	float2 right(0, 0), left(0, 0);  // the wedge, counterclockwise from right to left
+	bool bounded = false;
+	auto narrow = [&](float2 v, float distance)
+	{
+		if (distance <= drift)
+			return;
+		const auto s = drift / distance;
+		const auto c = sqrt(1 - s * s);
+		const float2 r(v.x * c + v.y * s, v.y * c - v.x * s);
+		const float2 l(v.x * c - v.y * s, v.y * c + v.x * s);
+		if (!bounded || cross(right, r) > 0)
+			right = r;
+		if (!bounded || cross(l, left) > 0)
+			left = l;
+		bounded = true;
+	};
+
+	output.clear();
+	float reach = 0;  // of the run from its anchor
+	for (const auto& p: points)
+	{
+		if (!output.empty() && p.x == output.back().x && p.y == output.back().y)
+			continue;
+
+		if (output.size() >= 2)
+		{
+			const auto v = p - output[output.size() - 2];
+			const auto distance = sqrt(dot(v, v));
+			const auto inside = !bounded || (cross(right, v) >= 0 && cross(v, left) >= 0);
+			if (inside && distance >= reach)
+			{
+				output.back() = p;
+				reach = distance;
+				narrow(v, distance);
+				continue;
+			}
+		}
+
+		output.push_back(p);
+		bounded = false;
+		reach = 0;
+		if (output.size() >= 2)
+		{
+			const auto v = p - output[output.size() - 2];
+			reach = sqrt(dot(v, v));
+			narrow(v, reach);
+		}
+	}
+
+	// Douglas-Peucker without recursion
+	const auto size = output.size();
+	if (size > 2)
+	{
+		thread_local vector<uint8_t> keep;
+		thread_local vector<pair<size_t, size_t>> ranges;
+		keep.assign(size, 0);
+		keep.front() = keep.back() = 1;
+		ranges.assign(1, { 0, size - 1 });
+
+		const auto limit = (tolerance - drift) * (tolerance - drift);
+		while (!ranges.empty())
+		{
+			const auto [first, last] = ranges.back();
+			ranges.pop_back();
+			if (last - first < 2)
+				continue;
+
+			const auto [index, distance] = farthest(output.data(), first, last);
+			if (distance > limit)
+			{
+				keep[index] = 1;
+				ranges.emplace_back(first, index);
+				ranges.emplace_back(index, last);
+			}
+		}
+
+		size_t kept = 0;
+		for (size_t i = 0; i < size; i++)
+			if (keep[i])
+				output[kept++] = output[i];
+		output.resize(kept);
+	}
+
+	TRACE_COUNT("points simplified away", points.size() - output.size());
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "../utils/Math.h"
+#include <vector>
+
+
+// Largest distance simplification may move a font outline, as a fraction of the precision it
+// was flattened with
+#define SIMPLIFY_TOLERANCE 0.25
+
+// Copy points to output without the points that move the path by at most `tolerance`:
+// repeated points, runs of nearly collinear points, and then whatever Douglas-Peucker can
+// drop. No point ends up farther than `tolerance` from the output, and the first and last
+// points are always kept. Distances are computed with SSE when available.
+void simplifyPath(const std::vector<float2>& points, float tolerance, std::vector<float2>& output);
@@ -1,10 +1,14 @@
 #include "graphics/Mesh.h"
+#include "graphics/SVG.h"
 #include "text/Font.h"
+#include "utils/Trace.h"
 #include <chrono>
 #include <set>
 
 using namespace std;
 
+#define SAVE_FONT_BUNDLE 0  // also merge the packs into fonts.bundle, see saveFontBundle
+
 
 int main()
 {
@@ -12,7 +16,6 @@ int main()
 	{
 		const auto start = chrono::high_resolution_clock::now();
 
-		void saveSVG(const filesystem::path& filename);
 		saveSVG("/Users/hani/Downloads/Logo.svg");
 
 		const auto end = chrono::high_resolution_clock::now();
@@ -25,11 +28,28 @@ int main()
 	const filesystem::path folder = "/Users/hani/Downloads/fonts/";
 	const set<string> extentions = { ".woff2", ".ttf", ".otf" };
 
+	// X.ttf and X.woff2 both write X.bin, which is listed once
+	set<filesystem::path> packs;
 	for (auto& entry: filesystem::directory_iterator(folder))
 	{
-		auto& path = entry.path();
-		if (extentions.find(path.extension()) != extentions.end())
-			saveFontUsingFreeTypeAndLibTess(path);
+		auto path = entry.path();
+		if (extentions.find(path.extension()) != extentions.end()
+			&& saveFontUsingFreeTypeAndLibTess(path) == 0)
+			packs.insert(path.replace_extension(".bin"));
 	}
+
+	if (SAVE_FONT_BUNDLE)
+	{
+		try
+		{
+			saveFontBundle(folder / "fonts.bundle", { packs.begin(), packs.end() });
+		}
+		catch (const exception& e)
+		{
+			printf("Could not save the font bundle: %s\n", e.what());
+		}
+	}
+
+	TRACE_EXPORT(folder / "trace.json");
 	return 0;
 }
@@ -3,6 +3,7 @@
 #include "../graphics/Mesh.h"
 #include <vector>
 #include <filesystem>
+#include <memory>
 #include <string>
 
 
@@ -16,7 +17,74 @@ struct ShapedGlyph
 std::vector<ShapedGlyph>
 	shapeWithHarfbuzz(const std::string& text, const std::filesystem::path& fontFilename);
 
+struct FontOptions
+{
+	// meshes per glyph; every level is flattened with twice the tolerance of the previous
+	// one, starting at CURVES_PRECISION. More than one also writes the "lod" blocks.
+	int levelsOfDetail = 1;
+
+	// keep composite glyphs (accented letters...) as instances of their components instead
+	// of meshing each of them, see GlyphInstances
+	bool instanceComposites = false;
+
+	// for variable fonts, also store per-vertex deltas towards both ends of every axis so
+	// that instances reuse the triangulation of the default one, see VariationAxis
+	bool variations = false;
+
+	// mesh the outline of glyphs, this wide in em, instead of filling them
+	float strokeWidth = 0;
+
+	// tessellate the islands of every glyph separately, see Collection::setSplitIslands
+	bool splitIslands = false;
+};
+
 void saveFont_ttf2mesh(const std::filesystem::path& filename);
-int saveFontUsingFreeTypeAndLibTess(const std::filesystem::path& filename);
+int saveFontUsingFreeTypeAndLibTess(
+	const std::filesystem::path& filename,
+	const FontOptions& options = {});
+
+// One pack holding the blocks of many font packs, so all fonts are served from a single
+// mapping and descriptor table. Block "vert" of Lato-Regular.bin is "Lato-Regular/vert".
+#define FONT_BUNDLE_SIGNATURE "FNTBDL"
+
+inline std::string bundleBlock(const std::string& font, const std::string& block)
+{
+	return font + "/" + block;
+}
 
-std::string* readWOFF2(const std::filesystem::path& filename);
+// Merge font packs into a bundle, copying their blocks without recompressing them
+void saveFontBundle(
+	const std::filesystem::path& filename,
+	const std::vector<std::filesystem::path>& packs);
+
+// Decompress a WOFF2 font into a TrueType/OpenType (sfnt) buffer, empty on failure
+std::vector<uint8_t> decodeWOFF2(const uint8_t* data, size_t size);
+
+
+// Uncompressed (sfnt) bytes of a font file, shared by FreeType, HarfBuzz and ttf2mesh: each
+// font is loaded once while anything holds it and freed with the last reference, so a batch
+// does not keep the fonts it is done with. TTF/OTF files are memory-mapped and used in place;
+// WOFF2 files are decoded into a buffer owned by this object. With a cache folder set, the
+// decoded font is also written there, keyed by a hash of the WOFF2 file, and later runs map
+// that file instead of decoding again.
+class FontData
+{
+public:
+	// null, after printing why, when the file cannot be read or decoded
+	static std::shared_ptr<const FontData> load(const std::filesystem::path& filename);
+
+	static void setCacheFolder(const std::filesystem::path& folder);
+	static void clear();  // forgets loaded fonts, data stays alive while referenced
+
+	const uint8_t* data() const { return bytes; }
+	size_t size() const { return length; }
+
+	FontData(const std::filesystem::path& filename);
+
+private:
+	std::unique_ptr<File::Mapping> mapping;
+	std::vector<uint8_t> decoded;
+
+	const uint8_t* bytes = nullptr;
+	size_t length = 0;
+};
@@ -0,0 +1,25 @@
+#include "Font.h"
+#include <set>
+
+using namespace std;
+
+
+void saveFontBundle(const filesystem::path& filename, const vector<filesystem::path>& packs)
+{
+	TRACE_ZONE("font/bundle");
+
+	File::Pack bundle(filename, 'w', FONT_BUNDLE_SIGNATURE);
+	set<string> fonts;
+	for (const auto& path: packs)
+	{
+		const auto font = path.stem().u8string();
+		if (!fonts.insert(font).second)
+			throw runtime_error("Two packs named " + font);
+
+		File::Pack pack(path, 'r', "FNTMSH");
+		for (const auto& name: pack.names())
+			bundle.copy(pack, name, bundleBlock(font, ""));
+	}
+
+	printf("Bundle '%s' with %zu fonts saved.\n", filename.stem().c_str(), fonts.size());
+}
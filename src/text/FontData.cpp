@@ -0,0 +1,128 @@
+#include "Font.h"
+#include <map>
+#include <mutex>
+#include <random>
+
+using namespace std;
+
+
+namespace
+{
+	mutex cacheMutex;
+	map<filesystem::path, weak_ptr<const FontData>> cache;  // fonts someone still holds
+	filesystem::path cacheFolder;
+
+	// FNV-1a, only used to name files in the cache folder
+	uint64_t contentHash(const uint8_t* data, size_t size)
+	{
+		uint64_t h = 0xcbf2'9ce4'8422'2325;
+		for (size_t i = 0; i < size; i++)
+			h = (h ^ data[i]) * 0x100'0000'01b3;
+		return h;
+	}
+
+	// Written under a temporary name in the same folder and renamed into place, so a run that
+	// is interrupted or cannot write leaves no truncated file for later runs to map. Failing
+	// only costs decoding the font again next time.
+	void writeCacheFile(const vector<uint8_t>& data, const filesystem::path& filename)
+	{
+		auto temporary = filename;
+		temporary += "." + to_string(random_device()()) + ".tmp";
+
+		auto file = fopen(temporary.string().c_str(), "wb");
+		bool written = file && fwrite(data.data(), data.size(), 1, file) == 1;
+		if (file && fclose(file) != 0)
+			written = false;
+
+		error_code error;
+		if (written)
+			filesystem::rename(temporary, filename, error);
+		if (!written || error)
+		{
+			filesystem::remove(temporary, error);
+			fprintf(stderr, "Unable to write font cache '%s'\n", filename.u8string().c_str());
+		}
+	}
+}
+
+
+FontData::FontData(const filesystem::path& filename)
+{
+	TRACE_ZONE("font/load");
+
+	mapping = make_unique<File::Mapping>(filename);
+	bytes = mapping->data();
+	length = mapping->size();
+
+	if (filename.extension() != ".woff2")
+		return;
+
+	filesystem::path cached;
+	if (!cacheFolder.empty())
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.ttf", (unsigned long long)contentHash(bytes, length));
+		cached = cacheFolder / name;
+
+		if (filesystem::exists(cached))
+		{
+			mapping = make_unique<File::Mapping>(cached);
+			bytes = mapping->data();
+			length = mapping->size();
+			return;
+		}
+	}
+
+	decoded = decodeWOFF2(bytes, length);
+	if (decoded.empty())
+		throw runtime_error("WOFF2 decompression failed");
+
+	mapping.reset();
+	bytes = decoded.data();
+	length = decoded.size();
+
+	if (!cached.empty())
+		writeCacheFile(decoded, cached);
+}
+
+
+shared_ptr<const FontData> FontData::load(const filesystem::path& filename)
+{
+	// holding the lock while decoding guarantees each font is decoded only once
+	lock_guard<mutex> lock(cacheMutex);
+
+	for (auto it = cache.begin(); it != cache.end();)
+		it = it->second.expired() ? cache.erase(it) : next(it);
+
+	const auto key = filesystem::absolute(filename).lexically_normal();
+	auto& entry = cache[key];
+	auto font = entry.lock();
+	if (!font)
+		try
+		{
+			font = make_shared<const FontData>(filename);
+			entry = font;
+		}
+		catch (const exception& e)
+		{
+			cache.erase(key);
+			const auto name = filename.u8string();
+			fprintf(stderr, "Error loading font '%s': %s\n", name.c_str(), e.what());
+			return nullptr;
+		}
+	return font;
+}
+
+void FontData::setCacheFolder(const filesystem::path& folder)
+{
+	lock_guard<mutex> lock(cacheMutex);
+	cacheFolder = folder;
+	if (!folder.empty())
+		filesystem::create_directories(folder);
+}
+
+void FontData::clear()
+{
+	lock_guard<mutex> lock(cacheMutex);
+	cache.clear();
+}
@@ -0,0 +1,208 @@
+#include "Outline.h"
+#include <string.h>
+
+using namespace std;
+
+
+namespace
+{
+	// sfnt data is big-endian
+	inline uint16_t read16(const uint8_t* p)
+	{
+		return uint16_t(p[0] << 8 | p[1]);
+	}
+
+	inline uint32_t read32(const uint8_t* p)
+	{
+		return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+	}
+
+	// flags of simple glyph points
+	enum : uint8_t
+	{
+		ON_CURVE = 0x01,
+		X_SHORT = 0x02,
+		Y_SHORT = 0x04,
+		REPEAT = 0x08,
+		X_SAME = 0x10,  // or positive when short
+		Y_SAME = 0x20,
+		CUBIC = 0x80,  // not in the specification yet, left to FreeType
+	};
+
+	// Coordinates stored as deltas from the previous point, one byte or two each
+	bool readCoordinates(
+		const uint8_t*& p,
+		const uint8_t* end,
+		const vector<uint8_t>& flags,
+		uint8_t shortFlag,
+		uint8_t sameFlag,
+		FT_Pos FT_Vector::*axis,
+		vector<FT_Vector>& points)
+	{
+		FT_Pos value = 0;
+		for (size_t i = 0; i < flags.size(); i++)
+		{
+			const auto flag = flags[i];
+			if (flag & shortFlag)
+			{
+				if (p >= end)
+					return false;
+				value += flag & sameFlag ? *p : -*p;
+				p++;
+			}
+			else if (!(flag & sameFlag))
+			{
+				if (end - p < 2)
+					return false;
+				value += (int16_t)read16(p);
+				p += 2;
+			}
+			points[i].*axis = value;
+		}
+		return true;
+	}
+}
+
+
+GlyfTable::GlyfTable(const uint8_t* font, size_t size)
+{
+	if (size < 12)
+		return;
+
+	// a collection holds the offsets of its fonts, FreeType opens the first one
+	size_t offset = 0;
+	if (memcmp(font, "ttcf", 4) == 0)
+	{
+		if (size < 16 || (offset = read32(font + 12)) > size - 12)
+			return;
+	}
+
+	const auto* directory = font + offset;
+	const auto numTables = read16(directory + 4);
+	if (offset + 12 + numTables * size_t(16) > size)
+		return;
+
+	const uint8_t* head = nullptr;
+	const uint8_t* maxp = nullptr;
+	const uint8_t* hhea = nullptr;
+	for (unsigned i = 0; i < numTables; i++)
+	{
+		const auto* record = directory + 12 + i * 16;
+		const auto tableOffset = read32(record + 8);
+		const auto tableSize = read32(record + 12);
+		if (tableOffset > size || tableSize > size - tableOffset)
+			return;
+
+		const auto* table = font + tableOffset;
+		if (memcmp(record, "head", 4) == 0 && tableSize >= 54)
+			head = table;
+		else if (memcmp(record, "maxp", 4) == 0 && tableSize >= 6)
+			maxp = table;
+		else if (memcmp(record, "hhea", 4) == 0 && tableSize >= 36)
+			hhea = table;
+		else if (memcmp(record, "hmtx", 4) == 0)
+			hmtx = table, hmtxSize = tableSize;
+		else if (memcmp(record, "loca", 4) == 0)
+			loca = table, locaSize = tableSize;
+		else if (memcmp(record, "glyf", 4) == 0)
+			glyf = table, glyfSize = tableSize;
+	}
+
+	numGlyphs = maxp ? read16(maxp + 4) : 0;
+	numHMetrics = hhea && hmtx ? read16(hhea + 34) : 0;
+	longOffsets = head && read16(head + 50) != 0;
+	if (!head || !loca || locaSize < (numGlyphs + size_t(1)) * (longOffsets ? 4 : 2))
+		glyf = nullptr;
+}
+
+// As FreeType reads it from hmtx, 0 when missing
+int GlyfTable::leftBearing(unsigned index) const
+{
+	if (numHMetrics == 0)
+		return 0;
+
+	// glyphs past the last metric repeat its advance and only store their bearing
+	const size_t offset =
+		index < numHMetrics ? index * 4 + 2 : numHMetrics * 4 + (index - numHMetrics) * 2;
+	return offset + 2 <= hmtxSize ? (int16_t)read16(hmtx + offset) : 0;
+}
+
+bool GlyfTable::read(unsigned index, GlyfOutline& outline) const
+{
+	outline.points.clear();
+	outline.onCurve.clear();
+	outline.contourEnds.clear();
+	if (!glyf || index >= numGlyphs)
+		return false;
+
+	const auto start = longOffsets ? read32(loca + index * 4) : read16(loca + index * 2) * 2u;
+	const auto end =
+		longOffsets ? read32(loca + index * 4 + 4) : read16(loca + index * 2 + 2) * 2u;
+	if (start == end)
+		return true;  // no outline, like a space
+	if (start > end || end > glyfSize || end - start < 10)
+		return false;
+
+	const auto* p = glyf + start;
+	const auto* limit = glyf + end;
+	const auto numContours = (int16_t)read16(p);
+	if (numContours < 0)
+		return false;  // composite
+
+	// FreeType puts the first phantom point (pp1) at xMin - lsb and moves the outline so that
+	// pp1 is the origin, shifting every point by lsb - xMin. The bench checks this against
+	// FT_LOAD_NO_SCALE on glyphs whose lsb is not their xMin.
+	const auto xMin = (int16_t)read16(p + 2);
+	const FT_Pos shift = leftBearing(index) - xMin;
+	p += 10;
+
+	if (limit - p < numContours * 2 + 2)
+		return false;
+	int previous = -1;
+	for (int i = 0; i < numContours; i++, p += 2)
+	{
+		const int last = read16(p);
+		if (last <= previous)
+			return false;
+		outline.contourEnds.push_back(previous = last);
+	}
+	const size_t numPoints = previous + 1;
+
+	const auto instructions = read16(p);
+	p += 2;
+	if (limit - p < instructions)
+		return false;
+	p += instructions;
+
+	// flags, with runs of the same one stored once
+	auto& flags = outline.onCurve;
+	while (flags.size() < numPoints)
+	{
+		if (p >= limit)
+			return false;
+		const auto flag = *p++;
+		if (flag & CUBIC)
+			return false;
+
+		size_t count = 1;
+		if (flag & REPEAT)
+		{
+			if (p >= limit)
+				return false;
+			count += *p++;
+		}
+		flags.insert(flags.end(), min(count, numPoints - flags.size()), flag);
+	}
+
+	outline.points.resize(numPoints);
+	auto& points = outline.points;
+	if (!readCoordinates(p, limit, flags, X_SHORT, X_SAME, &FT_Vector::x, points)
+		|| !readCoordinates(p, limit, flags, Y_SHORT, Y_SAME, &FT_Vector::y, points))
+		return false;
+
+	for (auto& point: points)
+		point.x += shift;
+	for (auto& flag: flags)
+		flag &= ON_CURVE;
+	return true;
+}
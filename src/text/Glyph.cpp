@@ -1,45 +1,78 @@
 #include "Font.h"
+#include "Outline.h"
 
-#include <ft2build.h>
-#include FT_FREETYPE_H
 #include FT_OUTLINE_H
+#include FT_MULTIPLE_MASTERS_H
 
 #include <iostream>
 
 using namespace std;
 
 
-float normalizationMul;
+// component of a composite glyph; x' = t[0] x + t[1] y + t[2], y' = t[3] x + t[4] y + t[5]
+struct Component
+{
+	FT_UInt index;
+	float transform[6];
+};
 
 struct ContourWithIndex
 {
 	FT_UInt index;
-	vector<vector<float2>> subContours;
+	vector<vector<float2>> subContours;  // in font units
+	float maxError = 0;                  // also
+	vector<Component> components;
+	CurveSegments segments;  // only recorded for variable fonts
+
+	explicit ContourWithIndex(FT_UInt index) : index(index) {}
 
 	bool operator==(const ContourWithIndex& rhs) const { return this->index == rhs.index; }
 };
 
-vector<ContourWithIndex> contours;
-vector<vector<float2>> currentContour;
+// contours[level][glyph]
+vector<vector<ContourWithIndex>> contours;
 
-float2 FT_Vector_to_float2(const FT_Vector* v)
+size_t countPoints(const ContourWithIndex& contour)
 {
-	return float2(v->x, v->y) * normalizationMul;
+	size_t count = 0;
+	for (const auto& subContour: contour.subContours)
+		count += subContour.size();
+	return count;
 }
 
+struct OutlineDecomposer
+{
+	Contours& contours;
+	float scale;
+	double precision;
+	float maxError = 0;
+	CurveSegments* segments = nullptr;
+
+	float2 toFloat2(const FT_Vector* v) const { return float2(v->x, v->y) * scale; }
+
+	// the estimated count, unless replaying the counts of another instance of the glyph
+	int segmentCount(int estimated)
+	{
+		if (!segments)
+			return estimated;
+		if (segments->next == segments->counts.size())
+			segments->counts.push_back(estimated);
+		return segments->counts[segments->next++];
+	}
+};
 
-#define CURVES_PRECISION 0.01
 
 int moveTo(const FT_Vector* to, void* user)
 {
-	currentContour.push_back({});
-	currentContour.back() = { FT_Vector_to_float2(to) };
+	auto& d = *(OutlineDecomposer*)user;
+	d.contours.push_back({ d.toFloat2(to) });
 	return 0;  // Return value of 0 indicates success
 }
 
 int lineTo(const FT_Vector* to, void* user)
 {
-	currentContour.back().push_back(FT_Vector_to_float2(to));
+	auto& d = *(OutlineDecomposer*)user;
+	d.contours.back().push_back(d.toFloat2(to));
 	return 0;
 }
 
@@ -113,29 +146,44 @@ static inline int
 }
 
 // Simple function to approximate a cubic Bezier curve with line segments
-int cubicTo(
-	const FT_Vector* control1,
-	const FT_Vector* control2,
-	const FT_Vector* to,
-	void* user)
+float flattenCubicSegments(vector<float2>& contour, float2 P1, float2 P2, float2 P3, int segments)
 {
-	float2 P0 = currentContour.back().back();  // Last point added is the start of this curve
-	float2 P1 = FT_Vector_to_float2(control1);
-	float2 P2 = FT_Vector_to_float2(control2);
-	float2 P3 = FT_Vector_to_float2(to);
-
-	int segments = estimateBezierSegmentsCubic(P0, P1, P2, P3, CURVES_PRECISION);
+	float2 P0 = contour.back();  // Last point added is the start of this curve
 
-	currentContour.back().push_back(P0);
-	// currentContour.back().push_back((P1 + P2) / 2.f);
+	contour.push_back(P0);
+	// contour.push_back((P1 + P2) / 2.f);
 	for (int i = 1; i < segments; ++i)
 	{
 		double t = i / double(segments);
 		float2 pt = cubicBezier(P0, P1, P2, P3, t);
-		currentContour.back().push_back(pt);
+		contour.push_back(pt);
 	}
-	currentContour.back().push_back(P3);
+	contour.push_back(P3);
 
+	// a chord over a parameter step h deviates at most h^2 / 8 * max|B''| from the curve
+	const float h = 1.0f / max(segments, 1);
+	return 0.75f * h * h * max(length(P0 - 2 * P1 + P2), length(P1 - 2 * P2 + P3));
+}
+
+float flattenCubic(vector<float2>& contour, float2 P1, float2 P2, float2 P3, double precision)
+{
+	const auto segments = estimateBezierSegmentsCubic(contour.back(), P1, P2, P3, precision);
+	return flattenCubicSegments(contour, P1, P2, P3, segments);
+}
+
+int cubicTo(
+	const FT_Vector* control1,
+	const FT_Vector* control2,
+	const FT_Vector* to,
+	void* user)
+{
+	auto& d = *(OutlineDecomposer*)user;
+	auto& contour = d.contours.back();
+	const auto P1 = d.toFloat2(control1), P2 = d.toFloat2(control2), P3 = d.toFloat2(to);
+	const auto segments = d.segmentCount(
+		estimateBezierSegmentsCubic(contour.back(), P1, P2, P3, d.precision));
+	const auto error = flattenCubicSegments(contour, P1, P2, P3, segments);
+	d.maxError = max(d.maxError, error);
 	return 0;
 }
 
@@ -146,29 +194,379 @@ float2 quadraticBezier(const float2& P0, const float2& P1, const float2& P2, dou
 }
 
 // Function to flatten a quadratic Bezier curve using line segments
-int quadraticTo(const FT_Vector* control, const FT_Vector* to, void* user)
+float flattenQuadraticSegments(vector<float2>& contour, float2 P1, float2 P2, int segments)
 {
-	float2 P0 = currentContour.back().back();  // Start point is the last point added
-	float2 P1 = FT_Vector_to_float2(control);  // Control point
-	float2 P2 = FT_Vector_to_float2(to);       // End point
+	float2 P0 = contour.back();  // Start point is the last point added
 
-	int segments = estimateBezierSegmentsQuadratic(P0, P1, P2, CURVES_PRECISION);
-
-	currentContour.back().push_back(P0);
-	// currentContour.back().push_back(P1);
+	contour.push_back(P0);
+	// contour.push_back(P1);
 	for (int i = 1; i < segments; ++i)
 	{
 		double t = i / double(segments);
 		float2 pt = quadraticBezier(P0, P1, P2, t);
-		currentContour.back().push_back(pt);
+		contour.push_back(pt);
 	}
-	currentContour.back().push_back(P2);
+	contour.push_back(P2);
+
+	const float h = 1.0f / max(segments, 1);
+	return 0.25f * h * h * length(P0 - 2 * P1 + P2);
+}
 
+float flattenQuadratic(vector<float2>& contour, float2 P1, float2 P2, double precision)
+{
+	const auto segments = estimateBezierSegmentsQuadratic(contour.back(), P1, P2, precision);
+	return flattenQuadraticSegments(contour, P1, P2, segments);
+}
+
+int quadraticTo(const FT_Vector* control, const FT_Vector* to, void* user)
+{
+	auto& d = *(OutlineDecomposer*)user;
+	auto& contour = d.contours.back();
+	const auto P1 = d.toFloat2(control), P2 = d.toFloat2(to);
+	const auto segments =
+		d.segmentCount(estimateBezierSegmentsQuadratic(contour.back(), P1, P2, d.precision));
+	const auto error = flattenQuadraticSegments(contour, P1, P2, segments);
+	d.maxError = max(d.maxError, error);
 	return 0;  // Return 0 to indicate success
 }
 
-int saveFontUsingFreeTypeAndLibTess(const filesystem::path& filename)
+bool decomposeOutline(
+	FT_Outline* outline,
+	float scale,
+	Contours& contours,
+	double precision,
+	float* maxError,
+	CurveSegments* segments)
+{
+	FT_Outline_Funcs funcs;
+	funcs.move_to = moveTo;
+	funcs.line_to = lineTo;
+	funcs.conic_to = quadraticTo;
+	funcs.cubic_to = cubicTo;
+	funcs.shift = 0;
+	funcs.delta = 0;
+
+	OutlineDecomposer decomposer { contours, scale, precision, 0, segments };
+	if (segments)
+		segments->next = 0;
+	const auto decomposed = FT_Outline_Decompose(outline, &funcs, &decomposer) == 0;
+	if (maxError)
+		*maxError = decomposer.maxError;
+	return decomposed;
+}
+
+// The walk of FT_Outline_Decompose over TrueType points: a contour starting off the curve
+// starts at its last point, or halfway between the two, and two points off the curve in a row
+// have an implied one halfway, rounded like FreeType rounds it
+bool decomposeOutline(
+	const GlyfOutline* outline,
+	float scale,
+	Contours& contours,
+	double precision,
+	float* maxError,
+	CurveSegments* segments)
+{
+	OutlineDecomposer decomposer { contours, scale, precision, 0, segments };
+	if (segments)
+		segments->next = 0;
+
+	auto middle = [](const FT_Vector& a, const FT_Vector& b)
+	{ return FT_Vector { (a.x + b.x) / 2, (a.y + b.y) / 2 }; };
+
+	const auto* points = outline->points.data();
+	const auto* onCurve = outline->onCurve.data();
+	int first = 0;
+	for (const auto last: outline->contourEnds)
+	{
+		auto start = points[first];
+		auto point = first;
+		auto limit = last;
+		if (!onCurve[first])
+		{
+			if (onCurve[last])
+				start = points[last], limit--;
+			else
+				start = middle(start, points[last]);
+			point--;
+		}
+		moveTo(&start, &decomposer);
+
+		auto closed = false;
+		while (point < limit && !closed)
+		{
+			point++;
+			if (onCurve[point])
+			{
+				lineTo(&points[point], &decomposer);
+				continue;
+			}
+
+			auto control = points[point];
+			while (true)
+			{
+				if (point == limit)
+				{
+					quadraticTo(&control, &start, &decomposer);
+					closed = true;
+					break;
+				}
+
+				point++;
+				if (onCurve[point])
+				{
+					quadraticTo(&control, &points[point], &decomposer);
+					break;
+				}
+				const auto implied = middle(control, points[point]);
+				quadraticTo(&control, &implied, &decomposer);
+				control = points[point];
+			}
+		}
+		if (!closed)
+			lineTo(&start, &decomposer);
+		first = last + 1;
+	}
+
+	if (maxError)
+		*maxError = decomposer.maxError;
+	return true;
+}
+
+// False for components anchored by point numbers, which need the composite to be expanded
+bool readComponents(FT_GlyphSlot slot, float scale, vector<Component>& components)
 {
+	for (FT_UInt i = 0; i < slot->num_subglyphs; i++)
+	{
+		FT_Int index, arg1, arg2;
+		FT_UInt flags;
+		FT_Matrix matrix;
+		if (FT_Get_SubGlyph_Info(slot, i, &index, &flags, &arg1, &arg2, &matrix)
+			|| !(flags & FT_SUBGLYPH_FLAG_ARGS_ARE_XY_VALUES))
+			return false;
+
+		const float a = matrix.xx / 65536.0f, b = matrix.xy / 65536.0f;
+		const float c = matrix.yx / 65536.0f, d = matrix.yy / 65536.0f;
+		auto offset = float2(arg1, arg2) * scale;
+		// raw TrueType flags SCALED_COMPONENT_OFFSET and UNSCALED_COMPONENT_OFFSET
+		if ((flags & 0x800) && !(flags & 0x1000))
+			offset = float2(a * offset.x + b * offset.y, c * offset.x + d * offset.y);
+
+		components.push_back({ (FT_UInt)index, { a, b, offset.x, c, d, offset.y } });
+	}
+	return true;
+}
+
+// Resolve nested composites down to simple glyphs, as instances in the flipped space of the
+// saved vertices
+void addInstances(
+	const vector<Component>& components,
+	const float* parent,
+	const vector<int>& contourOf,
+	vector<MeshInstance>& instances,
+	int depth = 0)
+{
+	for (const auto& component: components)
+	{
+		const auto* c = component.transform;
+		const float t[6] = {
+			parent[0] * c[0] + parent[1] * c[3],
+			parent[0] * c[1] + parent[1] * c[4],
+			parent[0] * c[2] + parent[1] * c[5] + parent[2],
+			parent[3] * c[0] + parent[4] * c[3],
+			parent[3] * c[1] + parent[4] * c[4],
+			parent[3] * c[2] + parent[4] * c[5] + parent[5],
+		};
+
+		const auto contourIndex =
+			component.index < contourOf.size() ? contourOf[component.index] : -1;
+		if (contourIndex < 0)
+			continue;
+
+		const auto& nested = contours[0][contourIndex].components;
+		if (!nested.empty())
+		{
+			if (depth < 8)  // the nesting limit of FreeType is much lower anyway
+				addInstances(nested, t, contourOf, instances, depth + 1);
+			continue;
+		}
+
+		// y is saved as 1 - y
+		instances.push_back(
+			{ contourIndex, { t[0], -t[1], t[1] + t[2], -t[3], t[4], 1 - t[4] - t[5] } });
+	}
+}
+
+// Where a mesh vertex comes from: at `t` along the segment from point `point` of contour
+// `contour` to the next point. Vertices Clipper creates at intersections get t > 0.
+struct VertexSource
+{
+	int contour = -1;
+	int point = 0;
+	float t = 0;
+};
+
+float2 pointAt(const Contours& contours, const VertexSource& source)
+{
+	const auto& points = contours[source.contour];
+	const auto& next = points[(source.point + 1) % points.size()];
+	return lerpFloat2(points[source.point], next, source.t);
+}
+
+void findVertexSources(
+	const Contours& contours,
+	const vector<float2>& vertices,
+	float unitsPerEm,
+	int firstVertex,
+	int lastVertex,
+	vector<VertexSource>& sources)
+{
+	// Collection rounds points to OUTLINE_SUBUNITS and hands libtess2 exactly those positions
+	auto key = [](float2 p)
+	{
+		return ((uint64_t)(uint32_t)llround(p.x * OUTLINE_SUBUNITS) << 32)
+			   | (uint32_t)llround(p.y * OUTLINE_SUBUNITS);
+	};
+	unordered_map<uint64_t, VertexSource> points;
+	for (int c = 0; c < (int)contours.size(); c++)
+		for (int i = 0; i < (int)contours[c].size(); i++)
+			points.emplace(key(contours[c][i]), VertexSource { c, i });
+
+	for (int v = firstVertex; v <= lastVertex; v++)
+	{
+		const auto vertex = vertices[v] * unitsPerEm;  // font units, like the contours
+		const auto found = points.find(key(vertex));
+		if (found != points.end())
+		{
+			sources[v] = found->second;
+			continue;
+		}
+
+		// an intersection: keep it at the same place along the closest segment
+		float closest = numeric_limits<float>::max();
+		for (int c = 0; c < (int)contours.size(); c++)
+			for (int i = 0; i < (int)contours[c].size(); i++)
+			{
+				const auto& a = contours[c][i];
+				const auto& b = contours[c][(i + 1) % contours[c].size()];
+				const auto ab = b - a;
+				const auto squared = dot(ab, ab);
+				const auto t = squared > 0 ? clamp(dot(vertex - a, ab) / squared, 0.0f, 1.0f) : 0;
+				const auto distance = length(vertex - (a + ab * t));
+				if (distance < closest)
+					closest = distance, sources[v] = { c, i, t };
+			}
+	}
+}
+
+bool sameTopology(const Contours& a, const Contours& b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++)
+		if (a[i].size() != b[i].size())
+			return false;
+	return true;
+}
+
+// Deltas of every vertex from the default instance to both ends of every axis, as laid out
+// in "vardelta". meshSource gives the level and glyph of every mesh. Glyphs whose outline
+// changes topology along an axis keep their default shape there.
+vector<float2> computeVariationDeltas(
+	FT_Face face,
+	const FT_MM_Var& variations,
+	float unitsPerEm,
+	Collection& output,
+	const vector<pair<size_t, size_t>>& meshSource,
+	int& mismatches)
+{
+	TRACE_ZONE("font/variations");
+
+	const auto& vertices = output.getVertices();
+	const auto& indices = output.getIndices();
+	const auto& meshes = output.getMeshes();
+
+	vector<pair<int, int>> vertexRanges(meshes.size(), { 0, -1 });
+	vector<VertexSource> sources(vertices.size());
+	for (size_t mesh = 0; mesh < meshes.size(); mesh++)
+	{
+		if (meshes[mesh].indexCount == 0)
+			continue;
+		const auto first = indices.begin() + meshes[mesh].startIndex;
+		const auto range = minmax_element(first, first + meshes[mesh].indexCount);
+		vertexRanges[mesh] = { (int)*range.first, (int)*range.second };
+
+		const auto [level, contourIndex] = meshSource[mesh];
+		findVertexSources(
+			contours[level][contourIndex].subContours,
+			vertices,
+			unitsPerEm,
+			vertexRanges[mesh].first,
+			vertexRanges[mesh].second,
+			sources);
+	}
+
+	const auto numAxes = variations.num_axis;
+	vector<float2> deltas(2 * numAxes * vertices.size());
+	vector<FT_Fixed> coordinates(numAxes);
+	for (FT_UInt region = 0; region < 2 * numAxes; region++)
+	{
+		const auto& axis = variations.axis[region / 2];
+		const auto end = region % 2 ? axis.maximum : axis.minimum;
+		if (end == axis.def)
+			continue;
+
+		for (FT_UInt i = 0; i < numAxes; i++)
+			coordinates[i] = variations.axis[i].def;
+		coordinates[region / 2] = end;
+		FT_Set_Var_Design_Coordinates(face, numAxes, coordinates.data());
+
+		Contours instance;
+		for (size_t mesh = 0; mesh < meshes.size(); mesh++)
+		{
+			if (vertexRanges[mesh].second < vertexRanges[mesh].first)
+				continue;
+
+			const auto [level, contourIndex] = meshSource[mesh];
+			const auto& glyph = contours[level][contourIndex];
+			auto segments = glyph.segments;
+			instance.clear();
+			if (FT_Load_Glyph(face, glyph.index, FT_LOAD_NO_SCALE | FT_LOAD_NO_HINTING)
+				|| face->glyph->format != FT_GLYPH_FORMAT_OUTLINE
+				|| !decomposeOutline(
+					&face->glyph->outline,
+					1.0f,
+					instance,
+					CURVES_PRECISION * unitsPerEm * (1 << level),
+					nullptr,
+					&segments)
+				|| segments.counts.size() != glyph.segments.counts.size()
+				|| !sameTopology(glyph.subContours, instance))
+			{
+				mismatches++;
+				continue;
+			}
+
+			auto* regionDeltas = deltas.data() + region * vertices.size();
+			for (int v = vertexRanges[mesh].first; v <= vertexRanges[mesh].second; v++)
+			{
+				const auto delta =
+					(pointAt(instance, sources[v]) - pointAt(glyph.subContours, sources[v]))
+					/ unitsPerEm;
+				regionDeltas[v] = float2(delta.x, -delta.y);  // saved with y flipped
+			}
+		}
+	}
+
+	for (FT_UInt i = 0; i < numAxes; i++)
+		coordinates[i] = variations.axis[i].def;
+	FT_Set_Var_Design_Coordinates(face, numAxes, coordinates.data());
+	return deltas;
+}
+
+int saveFontUsingFreeTypeAndLibTess(const filesystem::path& filename, const FontOptions& options)
+{
+	TRACE_ZONE("font/freetype");
+
 	FT_Library library;  // Declare a FreeType library object
 	FT_Face face;        // Declare a FreeType face object
 
@@ -180,14 +578,13 @@ int saveFontUsingFreeTypeAndLibTess(const filesystem::path& filename)
 		return 1;
 	}
 
-	string* buffer = nullptr;
-	if (filename.extension() == ".woff2")
+	const auto font = FontData::load(filename);
+	if (!font)
 	{
-		buffer = readWOFF2(filename);
-		error = FT_New_Memory_Face(library, (FT_Byte*)buffer->data(), buffer->size(), 0, &face);
+		FT_Done_FreeType(library);
+		return 1;
 	}
-	else
-		error = FT_New_Face(library, filename.c_str(), 0, &face);
+	error = FT_New_Memory_Face(library, font->data(), font->size(), 0, &face);
 
 	if (error == FT_Err_Unknown_File_Format)
 	{
@@ -221,38 +618,94 @@ int saveFontUsingFreeTypeAndLibTess(const filesystem::path& filename)
 
 	// ...
 
-	normalizationMul = 1.0f / (float)face->units_per_EM;
+	// outlines stay in font units, which FreeType's integers convert to exactly, up to the
+	// fixed point coordinates of Collection; components and the output are in em
+	const float unitsPerEm = face->units_per_EM;
+	const float normalizationMul = 1.0f / unitsPerEm;
+	contours.resize(max(options.levelsOfDetail, 1));
+
+	FT_MM_Var* variations = nullptr;
+	if (options.variations && FT_HAS_MULTIPLE_MASTERS(face)
+		&& FT_Get_MM_Var(face, &variations))
+		variations = nullptr;
+
+	// composites are then left as a list of components instead of one merged outline
+	const auto loadFlags = FT_LOAD_NO_SCALE | FT_LOAD_NO_HINTING
+						   | (options.instanceComposites ? FT_LOAD_NO_RECURSE : 0);
+
+	// Simple TrueType glyphs are read straight from the font, concurrently since the reader
+	// keeps no state; FreeType loads the others, composites and CFF outlines, one at a time
+	const auto numLevels = contours.size();
+	vector<vector<ContourWithIndex>> glyphs(face->num_glyphs);  // [glyph][level]
+	auto decompose = [&](FT_UInt gindex, auto& outline)
+	{
+		auto& levels = glyphs[gindex];
+		for (size_t level = 0; level < numLevels; level++)
+		{
+			auto& contour = levels.emplace_back(gindex);
+			if (!decomposeOutline(
+					&outline,
+					1.0f,
+					contour.subContours,
+					CURVES_PRECISION * unitsPerEm * (1 << level),
+					&contour.maxError,
+					variations ? &contour.segments : nullptr))
+				cerr << "Error decomposing outline." << endl;
+		}
+		TRACE_COUNT("glyphs processed", 1);
+	};
+
+	const GlyfTable glyf(font->data(), font->size());
+	if (glyf.valid())
+		Parallel::forEach(
+			face->num_glyphs,
+			[&](size_t gindex)
+			{
+				TRACE_ZONE("font/glyf");
+				thread_local GlyfOutline outline;
+				if (glyf.read((unsigned)gindex, outline))
+					decompose((FT_UInt)gindex, outline);
+			});
 
 	for (FT_UInt gindex = 0; gindex < face->num_glyphs; gindex++)
 	{
-		// Load the glyph by its glyph index
-		error = FT_Load_Glyph(face, gindex, FT_LOAD_NO_SCALE | FT_LOAD_NO_HINTING);
-		if (!error && face->glyph->format == FT_GLYPH_FORMAT_OUTLINE)
-		{
-			FT_GlyphSlot slot = face->glyph;
-			FT_Outline* outline = &slot->outline;
+		if (!glyphs[gindex].empty())
+			continue;
 
-			currentContour.clear();
+		TRACE_ZONE("font/decompose");
 
-			FT_Outline_Funcs funcs;
-			funcs.move_to = moveTo;
-			funcs.line_to = lineTo;
-			funcs.conic_to = quadraticTo;
-			funcs.cubic_to = cubicTo;
-			funcs.shift = 0;
-			funcs.delta = 0;
+		// Load the glyph by its glyph index
+		error = FT_Load_Glyph(face, gindex, loadFlags);
 
-			if (FT_Outline_Decompose(outline, &funcs, nullptr))
-				cerr << "Error decomposing outline." << endl;
+		vector<Component> components;
+		if (!error && face->glyph->format == FT_GLYPH_FORMAT_COMPOSITE
+			&& !readComponents(face->glyph, normalizationMul, components))
+		{
+			components.clear();
+			error = FT_Load_Glyph(face, gindex, FT_LOAD_NO_SCALE | FT_LOAD_NO_HINTING);
+		}
 
-			contours.push_back(ContourWithIndex({ gindex, currentContour }));
+		if (!error && !components.empty())
+		{
+			auto& levels = glyphs[gindex];
+			for (size_t level = 0; level < numLevels; level++)
+				levels.emplace_back(gindex);
+			levels[0].components = components;
+			TRACE_COUNT("glyphs processed", 1);
 		}
+		else if (!error && face->glyph->format == FT_GLYPH_FORMAT_OUTLINE)
+			decompose(gindex, face->glyph->outline);
 		else
 		{
 			cerr << "Could not load glyph" << endl;
 		}
 	}
 
+	for (auto& levels: glyphs)
+		for (size_t level = 0; level < levels.size(); level++)
+			contours[level].push_back(move(levels[level]));
+	glyphs.clear();
+
 	/*
 	// sanity check: everything should be sequential
 	for (int contourIndex = 0; contourIndex < contours.size(); contourIndex++) {
@@ -268,19 +721,47 @@ int saveFontUsingFreeTypeAndLibTess(const filesystem::path& filename)
 	cout << "Clipping and Tesselating..." << endl;
 	auto start = chrono::high_resolution_clock::now();
 
-	Collection output;
-	for (int contourIndex = 0; contourIndex < contours.size(); contourIndex++)
-	{
-		output.addMesh();
-		ContourWithIndex contour = contours[contourIndex];
-		for (int subContourIndex = 0; subContourIndex < contour.subContours.size();
-			 subContourIndex++)
+	Stroke outlineStroke;
+	outlineStroke.width = options.strokeWidth * unitsPerEm;
+	outlineStroke.join = ClipperLib::jtRound;
+
+	// the finest level comes first so "mesh" still starts with one mesh per glyph
+	// variation deltas belong to one glyph each, so meshes must not be shared
+	Collection output(!variations);
+	output.setScale(OUTLINE_SUBUNITS, 1.0 / (OUTLINE_SUBUNITS * unitsPerEm));
+	output.setSplitIslands(options.splitIslands);
+	vector<pair<size_t, size_t>> meshSource;
+	const auto numGlyphs = contours[0].size();
+	vector<vector<MeshLOD>> glyphLevels(numGlyphs);
+	int numMeshes = 0;
+	for (size_t level = 0; level < contours.size(); level++)
+		for (size_t contourIndex = 0; contourIndex < numGlyphs; contourIndex++)
 		{
-			vector<float2> subContour = contour.subContours[subContourIndex];
-			if (subContour.size() > 0)
-				output.addPath(subContour);
+			const auto& contour = contours[level][contourIndex];
+			auto& levels = glyphLevels[contourIndex];
+
+			// a level without fewer points than the previous one has the very same outline
+			if (level > 0
+				&& countPoints(contour) == countPoints(contours[level - 1][contourIndex]))
+				continue;
+
+			TRACE_ZONE("font/glyph mesh");
+			const auto tolerance =
+				float(CURVES_PRECISION * unitsPerEm * (1 << level) * SIMPLIFY_TOLERANCE);
+			output.addMesh();
+			levels.push_back({ numMeshes++, (contour.maxError + tolerance) / unitsPerEm });
+			meshSource.emplace_back(level, contourIndex);
+			for (int subContourIndex = 0; subContourIndex < contour.subContours.size();
+				 subContourIndex++)
+			{
+				const auto& subContour = contour.subContours[subContourIndex];
+				TRACE_COUNT("points flattened", subContour.size());
+				if (subContour.size() > 0 && options.strokeWidth > 0)
+					output.addStroke(subContour, true, outlineStroke);
+				else if (subContour.size() > 0)
+					output.addPath(subContour, tolerance);
+			}
 		}
-	}
 	auto end = chrono::high_resolution_clock::now();
 	chrono::duration<double> duration = end - start;
 	cout << "Execution time: " << duration.count() << " seconds" << endl;
@@ -288,18 +769,94 @@ int saveFontUsingFreeTypeAndLibTess(const filesystem::path& filename)
 	cout << "Saving..." << endl;
 
 	auto outfile = filename;
-	output.save(outfile.replace_extension(".bin"));
+	{
+		File::Pack pack(outfile.replace_extension(".bin"), 'w', "FNTMSH");
+
+		// before save() flips the vertices
+		vector<float2> deltas;
+		int mismatches = 0;
+		if (variations)
+			deltas = computeVariationDeltas(
+				face,
+				*variations,
+				unitsPerEm,
+				output,
+				meshSource,
+				mismatches);
+
+		output.save(pack);
+		if (contours.size() > 1)
+		{
+			vector<GlyphLOD> lod;
+			vector<MeshLOD> lodLevels;
+			for (const auto& levels: glyphLevels)
+			{
+				lod.push_back({ (int)lodLevels.size(), (int)levels.size() });
+				lodLevels.insert(lodLevels.end(), levels.begin(), levels.end());
+			}
+			pack.add("lod", lod, 20);
+			pack.add("lodlevel", lodLevels, 20);
+			cout << "Levels of detail: " << numMeshes - numGlyphs << " extra meshes" << endl;
+		}
+		if (options.instanceComposites)
+		{
+			vector<int> contourOf(face->num_glyphs, -1);
+			for (size_t contourIndex = 0; contourIndex < numGlyphs; contourIndex++)
+				contourOf[contours[0][contourIndex].index] = (int)contourIndex;
+
+			const float identity[6] = { 1, 0, 0, 0, 1, 0 };
+			vector<GlyphInstances> composite;
+			vector<MeshInstance> instances;
+			int numComposites = 0;
+			for (const auto& contour: contours[0])
+			{
+				const auto first = (int)instances.size();
+				addInstances(contour.components, identity, contourOf, instances);
+				composite.push_back({ first, (int)instances.size() - first });
+				numComposites += !contour.components.empty();
+			}
+			pack.add("composite", composite, 20);
+			pack.add("instance", instances, 20);
+			cout << "Composite glyphs: " << numComposites << " drawn as " << instances.size()
+				 << " instances" << endl;
+		}
+		if (variations)
+		{
+			vector<VariationAxis> axes;
+			for (FT_UInt i = 0; i < variations->num_axis; i++)
+			{
+				const auto& axis = variations->axis[i];
+				axes.push_back(
+					{ (uint32_t)axis.tag,
+					  axis.minimum / 65536.0f,
+					  axis.def / 65536.0f,
+					  axis.maximum / 65536.0f });
+			}
+
+			vector<float> namedInstances;
+			for (FT_UInt i = 0; i < variations->num_namedstyles; i++)
+				for (FT_UInt axis = 0; axis < variations->num_axis; axis++)
+					namedInstances.push_back(variations->namedstyle[i].coords[axis] / 65536.0f);
+
+			pack.add("varaxis", axes, 20);
+			pack.add("varinstance", namedInstances, 20);
+			pack.add("vardelta", deltas, 20);
+			cout << "Variations: " << axes.size() << " axes, " << variations->num_namedstyles
+				 << " named instances, " << mismatches << " glyph outlines changing topology"
+				 << endl;
+		}
+	}
 
 	// Cleanup
+	if (variations)
+		FT_Done_MM_Var(library, variations);
 	FT_Done_Face(face);
 	FT_Done_FreeType(library);
-	if (buffer)
-		delete buffer;
 
-	currentContour.clear();
 	contours.clear();
 
 	cout << "Saved" << endl;
+	MEMORY_REPORT(filename.filename().u8string().c_str());
 
 	return 0;
 }
@@ -1,6 +1,9 @@
 #include "Font.h"
 #include "../utils/Compression.h"
 #include "../utils/File.h"
+#include "../utils/Parallel.h"
+#include "../utils/Trace.h"
+#include <climits>
 #include <ttf2mesh.h>
 
 using namespace std;
@@ -8,15 +11,15 @@ using namespace std;
 
 void saveFont_ttf2mesh(const filesystem::path& filename)
 {
+	TRACE_ZONE("font/ttf2mesh");
+
+	// ttf2mesh only reads the font, so it parses the shared mapping in place
 	ttf_t* ttf = nullptr;
-	if (filename.extension() == ".woff2")
 	{
-		auto buffer = readWOFF2(filename);
-		ttf_load_from_mem((uint8_t*)buffer->c_str(), buffer->size(), &ttf, false);
-		delete buffer;
+		const auto font = FontData::load(filename);
+		if (font && font->size() <= INT_MAX)
+			ttf_load_from_mem(font->data(), (int)font->size(), &ttf, false);
 	}
-	else
-		ttf_load_from_file(filename.u8string().c_str(), &ttf, false);
 
 	if (!ttf)
 	{
@@ -29,45 +32,100 @@ void saveFont_ttf2mesh(const filesystem::path& filename)
 
 	// metrics.lineHeight = (ttf->hhea.ascender - ttf->hhea.descender + ttf->hhea.lineGap);
 
-	std::vector<Mesh> meshes;
-	std::vector<float2> vertices;
-	std::vector<uint32_t> indices;
-	meshes.resize(ttf->nglyphs);
-	vertices.reserve(ttf->nglyphs * 125);
-	indices.reserve(ttf->nglyphs * 125 * 3);
+	// Glyphs are meshed in ranges on the worker pool. Each range collects its output in its
+	// own buffers (indices relative to the range) and frees every ttf2mesh mesh right away.
+	// Then the exact totals are known, and the ranges are copied into place in glyph order.
 
+	struct Range
+	{
+		vector<float2> vertices;
+		vector<uint32_t> indices;
+		size_t firstVertex = 0;
+		size_t firstIndex = 0;
+		int numErrors = 0;
+	};
+
+	const int glyphsPerRange = 64;
+	vector<Range> ranges((ttf->nglyphs + glyphsPerRange - 1) / glyphsPerRange);
+	vector<Mesh> meshes(ttf->nglyphs);
+
+	Parallel::forEach(
+		ranges.size(),
+		[&](size_t rangeIdx)
+		{
+			auto& range = ranges[rangeIdx];
+			const int end = min(ttf->nglyphs, (int)(rangeIdx + 1) * glyphsPerRange);
+
+			for (int glyphIdx = (int)rangeIdx * glyphsPerRange; glyphIdx < end; glyphIdx++)
+			{
+				TRACE_ZONE("ttf2mesh/glyph");
+
+				auto inputGlyph = &ttf->glyphs[glyphIdx];
+				auto& outputGlyph = meshes[glyphIdx];
+
+				ttf_mesh_t* mesh = nullptr;
+				if (inputGlyph->symbol == ' '
+					|| ttf_glyph2mesh(inputGlyph, &mesh, TTF_QUALITY_HIGH, TTF_FEATURE_IGN_ERR)
+						   != TTF_DONE)
+				{
+					ttf_free_mesh(mesh);
+					range.numErrors++;
+					continue;
+				}
+
+				const auto startVertex = (uint32_t)range.vertices.size();
+				outputGlyph.startIndex = (int)range.indices.size();
+				outputGlyph.indexCount = mesh->nfaces * 3;
+
+				for (int i = 0; i < mesh->nvert; i++)
+					range.vertices.emplace_back(mesh->vert[i].x, mesh->vert[i].y);
+
+				for (int i = 0; i < mesh->nfaces; i++)
+				{
+					range.indices.push_back(mesh->faces[i].v1 + startVertex);
+					range.indices.push_back(mesh->faces[i].v2 + startVertex);
+					range.indices.push_back(mesh->faces[i].v3 + startVertex);
+				}
+
+				TRACE_COUNT("glyphs processed", 1);
+				TRACE_COUNT("triangles emitted", mesh->nfaces);
+
+				ttf_free_mesh(mesh);
+			}
+		});
+
+	size_t numVertices = 0, numIndices = 0;
 	int numErrors = 0;
-
-	for (int glyphIdx = 0; glyphIdx < ttf->nglyphs; glyphIdx++)
+	for (auto& range: ranges)
 	{
-		auto inputGlyph = &ttf->glyphs[glyphIdx];
-		auto& outputGlyph = meshes[glyphIdx];
+		range.firstVertex = numVertices;
+		range.firstIndex = numIndices;
+		numVertices += range.vertices.size();
+		numIndices += range.indices.size();
+		numErrors += range.numErrors;
+	}
 
-		ttf_mesh_t* mesh = nullptr;
-		if (inputGlyph->symbol == ' '
-			|| ttf_glyph2mesh(inputGlyph, &mesh, TTF_QUALITY_HIGH, TTF_FEATURE_IGN_ERR)
-				   != TTF_DONE)
+	vector<float2> vertices(numVertices);
+	vector<uint32_t> indices(numIndices);
+
+	Parallel::forEach(
+		ranges.size(),
+		[&](size_t rangeIdx)
 		{
-			outputGlyph.startIndex = 0;
-			outputGlyph.indexCount = 0;
-			numErrors++;
-			continue;
-		}
+			TRACE_ZONE("ttf2mesh/merge");
 
-		const auto startVertex = (uint32_t)vertices.size();
-		outputGlyph.startIndex = (int)indices.size();
-		outputGlyph.indexCount = mesh->nfaces * 3;
+			auto& range = ranges[rangeIdx];
+			copy(range.vertices.begin(), range.vertices.end(), &vertices[range.firstVertex]);
+			for (size_t i = 0; i < range.indices.size(); i++)
+				indices[range.firstIndex + i] = range.indices[i] + (uint32_t)range.firstVertex;
 
-		for (int i = 0; i < mesh->nvert; i++)
-			vertices.emplace_back(mesh->vert[i].x, mesh->vert[i].y);
+			const int end = min(ttf->nglyphs, (int)(rangeIdx + 1) * glyphsPerRange);
+			for (int glyphIdx = (int)rangeIdx * glyphsPerRange; glyphIdx < end; glyphIdx++)
+				if (meshes[glyphIdx].indexCount)
+					meshes[glyphIdx].startIndex += (int)range.firstIndex;
 
-		for (int i = 0; i < mesh->nfaces; i++)
-		{
-			indices.push_back(mesh->faces[i].v1 + startVertex);
-			indices.push_back(mesh->faces[i].v2 + startVertex);
-			indices.push_back(mesh->faces[i].v3 + startVertex);
-		}
-	}
+			range = Range();
+		});
 
 	ttf_free(ttf);
 
@@ -90,4 +148,6 @@ void saveFont_ttf2mesh(const filesystem::path& filename)
 		numErrors,
 		vertices.size(),
 		indices.size());
+
+	MEMORY_REPORT(filename.filename().u8string().c_str());
 }
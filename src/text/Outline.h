@@ -0,0 +1,87 @@
+#pragma once
+
+#include "../utils/Math.h"
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <vector>
+
+
+#define CURVES_PRECISION 0.01  // in em
+#define OUTLINE_SUBUNITS 64    // fixed point steps per font unit in Clipper, as in 26.6
+
+using Contours = std::vector<std::vector<float2>>;
+
+// Append line segments approximating the curve that starts at contour.back(). Returns an
+// upper bound of the distance between the curve and those segments.
+float flattenQuadratic(std::vector<float2>& contour, float2 P1, float2 P2, double precision);
+float flattenCubic(
+	std::vector<float2>& contour,
+	float2 P1,
+	float2 P2,
+	float2 P3,
+	double precision);
+
+// Segment count of every curve of an outline. Decomposing with an empty one records them,
+// decomposing with a filled one reuses them, so that all instances of a variable glyph
+// flatten to corresponding points.
+struct CurveSegments
+{
+	std::vector<int> counts;
+	size_t next = 0;
+};
+
+// Flatten an outline into contours, multiplying its coordinates by `scale`. The largest
+// flattening error, in scaled units, is stored in maxError when given.
+bool decomposeOutline(
+	FT_Outline* outline,
+	float scale,
+	Contours& contours,
+	double precision = CURVES_PRECISION,
+	float* maxError = nullptr,
+	CurveSegments* segments = nullptr);
+
+
+// Points of a simple TrueType glyph as its glyf table stores them, in font units. Reused from
+// glyph to glyph, so reading many of them allocates only while the buffers grow.
+struct GlyfOutline
+{
+	std::vector<FT_Vector> points;
+	std::vector<uint8_t> onCurve;
+	std::vector<int> contourEnds;  // index of the last point of every contour
+};
+
+// The glyf and loca tables of a TrueType font (or the first font of a collection) in memory,
+// read without FreeType. Reading touches nothing but the font bytes, so threads can share one.
+class GlyfTable
+{
+public:
+	GlyfTable(const uint8_t* font, size_t size);
+
+	bool valid() const { return glyf != nullptr; }
+
+	// False for composite glyphs and anything it cannot read, which FreeType should load
+	bool read(unsigned index, GlyfOutline& outline) const;
+
+private:
+	int leftBearing(unsigned index) const;
+
+	const uint8_t* glyf = nullptr;
+	const uint8_t* loca = nullptr;
+	const uint8_t* hmtx = nullptr;
+	size_t glyfSize = 0;
+	size_t locaSize = 0;
+	size_t hmtxSize = 0;
+	unsigned numGlyphs = 0;
+	unsigned numHMetrics = 0;
+	bool longOffsets = false;
+};
+
+// decomposeOutline() for an outline read from the glyf table, with the same result as
+// decomposing the outline FreeType loads for the glyph
+bool decomposeOutline(
+	const GlyfOutline* outline,
+	float scale,
+	Contours& contours,
+	double precision = CURVES_PRECISION,
+	float* maxError = nullptr,
+	CurveSegments* segments = nullptr);
@@ -6,7 +6,18 @@ using namespace std;
 
 vector<ShapedGlyph> shapeWithHarfbuzz(const string& text, const filesystem::path& fontFilename)
 {
-	auto blob = hb_blob_create_from_file(fontFilename.u8string().c_str());
+	auto data = FontData::load(fontFilename);
+	if (!data)
+		return {};
+
+	// the blob keeps the shared font data alive until HarfBuzz releases it
+	auto font_data = new shared_ptr<const FontData>(move(data));
+	auto blob = hb_blob_create(
+		(const char*)(*font_data)->data(),
+		(unsigned int)(*font_data)->size(),
+		HB_MEMORY_MODE_READONLY,
+		font_data,
+		[](void* user_data) { delete (shared_ptr<const FontData>*)user_data; });
 	auto face = hb_face_create(blob, 0);
 	auto font = hb_font_create(face);
 
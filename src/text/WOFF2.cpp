@@ -1,20 +1,19 @@
 #include "Font.h"
-#include "../utils/File.h"
+#include "../utils/Trace.h"
 #include <woff2/decode.h>
 
 using namespace std;
 
 
-string* readWOFF2(const filesystem::path& filename)
+vector<uint8_t> decodeWOFF2(const uint8_t* data, size_t size)
 {
-	const auto compressed = File::readAll(filename);
-	auto estimate = woff2::ComputeWOFF2FinalSize(compressed.data(), compressed.size());
-	auto buffer = new string(estimate, 0);
-	woff2::WOFF2StringOut output(buffer);
-	if (!woff2::ConvertWOFF2ToTTF(compressed.data(), compressed.size(), &output))
-	{
-		printf("%s decompression failed.\n", filename.u8string().c_str());
-		buffer->clear();
-	}
+	TRACE_ZONE("woff2/decode");
+
+	vector<uint8_t> buffer(woff2::ComputeWOFF2FinalSize(data, size));
+	woff2::WOFF2MemoryOut output(buffer.data(), buffer.size());
+	if (!woff2::ConvertWOFF2ToTTF(data, size, &output))
+		return {};
+
+	buffer.resize(output.Size());
 	return buffer;
 }
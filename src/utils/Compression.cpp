@@ -8,9 +8,11 @@
 // #define ENABLE_ZPAQ
 
 #include "Compression.h"
+#include "Trace.h"
 
 #if defined(ENABLE_ZSTD)
 #	include <zstd.h>
+#	include <zdict.h>
 #endif
 #if defined(ENABLE_LIBDEFLATE)
 #	include <libdeflate.h>
@@ -26,12 +28,17 @@
 #	include <snappy.h>
 #endif
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <memory>
 #include <stdexcept>
 
 using namespace std;
 
 
-inline Compression detectCompression(const uint8_t* data, size_t size)
+Compression detectCompression(const uint8_t* data, size_t size)
 {
 #if defined(ENABLE_ZSTD)
 	if (size > 6 && *(uint32_t*)data == 0xFD2F'B528)
@@ -74,50 +81,85 @@ inline Compression detectCompression(const uint8_t* data, size_t size)
 }
 
 
+// A whole buffer through a reused context, into `compressed` sized to the codec's bound
+inline void compressAll(
+	Compressor& compressor,
+	vector<uint8_t>& compressed,
+	const uint8_t* data,
+	size_t size,
+	size_t bound)
+{
+	compressed.resize(bound);
+	auto* output = compressed.data();
+	auto space = compressed.size();
+	if (!compressor.run(data, size, output, space, true))
+		throw runtime_error("compressed data exceeds its bound");
+	compressed.resize(output - compressed.data());
+}
+
 #if defined(ENABLE_ZSTD)
 inline void
 	compressZstd(vector<uint8_t>& compressed, const uint8_t* data, size_t size, int level)
 {
-	// compressed.resize(ZSTD_compressBound(size));
-
-	// const auto ret = ZSTD_compress(compressed.data(), compressed.size(), data, size, level);
-	// if (ZSTD_isError(ret))
-	// 	throw runtime_error("ZSTD_compress failed");
-	// compressed.resize(ret);
-
-	compressed.resize(ZSTD_compressBound(size));
+	auto& compressor = Compressor::local(Compression::Zstd, level);
+	compressAll(compressor, compressed, data, size, ZSTD_compressBound(size));
+}
+#endif
 
-	auto ctx = ZSTD_createCCtx();
-	ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, level);
-	ZSTD_CCtx_setParameter(ctx, ZSTD_c_nbWorkers, 12);
 
-	const auto ret = ZSTD_compress2(ctx, compressed.data(), compressed.size(), data, size);
+vector<uint8_t> trainDictionary(const vector<vector<uint8_t>>& samples, size_t capacity)
+{
+#if defined(ENABLE_ZSTD)
+	TRACE_ZONE("compress/train");
 
-	ZSTD_freeCCtx(ctx);
+	vector<uint8_t> buffer;
+	vector<size_t> sizes;
+	for (const auto& sample: samples)
+	{
+		buffer.insert(buffer.end(), sample.begin(), sample.end());
+		sizes.push_back(sample.size());
+	}
 
-	if (ZSTD_isError(ret))
-		throw runtime_error("ZSTD_compress failed");
-	compressed.resize(ret);
+	vector<uint8_t> dictionary(capacity);
+	const auto size = ZDICT_trainFromBuffer(
+		dictionary.data(),
+		dictionary.size(),
+		buffer.data(),
+		sizes.data(),
+		(unsigned)sizes.size());
+	if (ZDICT_isError(size))
+		throw runtime_error(
+			string("ZDICT_trainFromBuffer failed: ") + ZDICT_getErrorName(size));
+	dictionary.resize(size);
+	return dictionary;
+#else
+	(void)samples, (void)capacity;
+	throw runtime_error("Zstd dictionaries need ENABLE_ZSTD");
+#endif
 }
 
-inline void decompressZstd(
-	const uint8_t* inputBuffer,
-	const size_t inputSize,
-	function<uint8_t*()> outputBuffer,
-	function<void(size_t)> outputResize)
+vector<uint8_t> compressWithDictionary(
+	const uint8_t* data,
+	size_t size,
+	const uint8_t* dictionary,
+	size_t dictionarySize,
+	int level)
 {
-	const auto contentSize = ZSTD_getFrameContentSize(inputBuffer, inputSize);
-	if (contentSize == ZSTD_CONTENTSIZE_ERROR || contentSize == ZSTD_CONTENTSIZE_UNKNOWN)
-		throw runtime_error("ZSTD_getFrameContentSize failed");
+#if defined(ENABLE_ZSTD)
+	TRACE_ZONE("compress");
+	TRACE_COUNT("bytes compressed", size);
 
-	outputResize(contentSize);
-	const auto actualSize =
-		ZSTD_decompress(outputBuffer(), contentSize, inputBuffer, inputSize);
-	if (ZSTD_isError(actualSize))
-		throw runtime_error("ZSTD_compress failed.");
-	outputResize(actualSize);
-}
+	vector<uint8_t> compressed;
+	auto& compressor = Compressor::local(Compression::Zstd, level, dictionary, dictionarySize);
+	compressAll(compressor, compressed, data, size, ZSTD_compressBound(size));
+
+	TRACE_COUNT("compressed bytes written", compressed.size());
+	return compressed;
+#else
+	(void)data, (void)size, (void)dictionary, (void)dictionarySize, (void)level;
+	throw runtime_error("Zstd dictionaries need ENABLE_ZSTD");
 #endif
+}
 
 
 #if defined(ENABLE_LIBDEFLATE)
@@ -155,8 +197,7 @@ inline void compressDeflate(
 inline void decompressDeflate(
 	const uint8_t* inputBuffer,
 	const size_t inputSize,
-	function<uint8_t*()> outputBuffer,
-	function<void(size_t)> outputResize)
+	vector<uint8_t>& output)
 {
 	auto ld = libdeflate_alloc_decompressor();
 
@@ -182,7 +223,7 @@ inline void decompressDeflate(
 	while (true)  // TODO: provide a limit to the number of loop iterations in case of error
 	{
 		auto bufferSize = size *= 4;
-		outputResize(bufferSize);
+		output.resize(bufferSize);
 
 		size_t actualSize = 0;
 		auto result = LIBDEFLATE_BAD_DATA;
@@ -192,7 +233,7 @@ inline void decompressDeflate(
 				ld,
 				inputBuffer,
 				inputSize,
-				outputBuffer(),
+				output.data(),
 				bufferSize,
 				&actualSize);
 		else if (method == Compression::zlib)
@@ -200,7 +241,7 @@ inline void decompressDeflate(
 				ld,
 				inputBuffer,
 				inputSize,
-				outputBuffer(),
+				output.data(),
 				bufferSize,
 				&actualSize);
 		else
@@ -208,13 +249,13 @@ inline void decompressDeflate(
 				ld,
 				inputBuffer,
 				inputSize,
-				outputBuffer(),
+				output.data(),
 				bufferSize,
 				&actualSize);
 
 		if (result == LIBDEFLATE_SUCCESS)
 		{
-			outputResize(actualSize);
+			output.resize(actualSize);
 			break;
 		}
 
@@ -231,32 +272,65 @@ inline void decompressDeflate(
 inline void
 	compressBrotli(vector<uint8_t>& compressed, const uint8_t* data, size_t size, int level)
 {
-	compressed.resize(BrotliEncoderMaxCompressedSize(size));
-	size_t actual = compressed.size();
-	if (!BrotliEncoderCompress(
-			level,
-			BROTLI_DEFAULT_WINDOW,
-			BROTLI_DEFAULT_MODE,
-			size,
-			data,
-			&actual,
-			compressed.data()))
-		throw runtime_error("BrotliEncoderCompress failed");
-	compressed.resize(actual);
+	auto& compressor = Compressor::local(Compression::Brotli, level);
+	compressAll(compressor, compressed, data, size, BrotliEncoderMaxCompressedSize(size) + 16);
 }
 
-inline void decompressBrotli(
-	const uint8_t* inputBuffer,
-	const size_t inputSize,
-	function<uint8_t*()> outputBuffer,
-	function<void(size_t)> outputResize)
+
+// Brotli states cannot be reset, so local contexts make a new one for every stream. Their
+// memory comes from this per-thread cache, which keeps freed blocks for the next state
+// instead of handing its large tables back to the system to be mapped and zeroed again.
+class BrotliMemory
 {
-	size_t actualSize = inputSize * 20;
-	outputResize(actualSize);
-	if (!BrotliDecoderDecompress(inputSize, inputBuffer, &actualSize, outputBuffer()))
-		throw runtime_error(" failed");
-	outputResize(actualSize);
-}
+public:
+	~BrotliMemory()
+	{
+		for (auto& [size, block]: cached)
+			free(block);
+	}
+
+	static void* allocate(void* opaque, size_t size)
+	{
+		auto& memory = *(BrotliMemory*)opaque;
+		const auto found = memory.cached.lower_bound(size);
+		if (found != memory.cached.end() && found->first <= size * 2)
+		{
+			auto* block = found->second;
+			memory.total -= found->first;
+			memory.cached.erase(found);
+			return block + header;
+		}
+
+		auto* block = (uint8_t*)malloc(size + header);
+		if (!block)
+			return nullptr;
+		*(size_t*)block = size;
+		return block + header;
+	}
+
+	static void release(void* opaque, void* address)
+	{
+		if (!address)
+			return;
+		auto& memory = *(BrotliMemory*)opaque;
+		auto* block = (uint8_t*)address - header;
+		const auto size = *(size_t*)block;
+		if (memory.total + size > limit)
+		{
+			free(block);
+			return;
+		}
+		memory.total += size;
+		memory.cached.emplace(size, block);
+	}
+
+private:
+	static constexpr size_t header = 16;  // holding the size, keeps blocks aligned
+	static constexpr size_t limit = 256 << 20;
+
+	multimap<size_t, uint8_t*> cached;
+	size_t total = 0;
+};
 #endif
 
 
@@ -283,8 +357,7 @@ inline void
 inline void decompressLZMA2(
 	const uint8_t* inputBuffer,
 	const size_t inputSize,
-	function<uint8_t*()> outputBuffer,
-	function<void(size_t)> outputResize)
+	vector<uint8_t>& output)
 {
 	lzma_stream strm = LZMA_STREAM_INIT;
 
@@ -295,8 +368,6 @@ inline void decompressLZMA2(
 	strm.next_in = inputBuffer;
 	strm.avail_in = inputSize;
 
-	size_t outputSize = 0;
-
 	do
 	{
 		strm.next_out = buffer.data();
@@ -311,10 +382,7 @@ inline void decompressLZMA2(
 		}
 
 		auto writeSize = buffer.size() - strm.avail_out;
-		outputResize(outputSize += writeSize);
-		copy_n(buffer.data(), writeSize, outputBuffer() + writeBegin);
-		// TODO: this won't work when Type is larger than byte and stream boundary is in the
-		// middle of one Type
+		output.insert(output.end(), buffer.data(), buffer.data() + writeSize);
 
 		if (ret == LZMA_STREAM_END)
 			break;
@@ -338,14 +406,12 @@ inline void compressSnappy(vector<uint8_t>& compressed, const uint8_t* data, siz
 inline void decompressSnappy(
 	const uint8_t* inputBuffer,
 	const size_t inputSize,
-	function<uint8_t*()> outputBuffer,
-	function<void(size_t)> outputResize)
+	vector<uint8_t>& output)
 {
 	string uc;
 	if (!snappy::Uncompress((char*)inputBuffer, inputSize, &uc))
 		throw invalid_argument("snappy decompression failed");
-	outputResize(uc.size());
-	copy(uc.begin(), uc.end(), outputBuffer());
+	output.assign(uc.begin(), uc.end());
 }
 #endif
 
@@ -412,33 +478,19 @@ private:
 class zpaqout : public libzpaq::Writer
 {
 public:
-	zpaqout(function<uint8_t*()> outputBuffer, function<void(size_t)> outputResize)
-		: outputBuffer(outputBuffer),
-		  outputResize(outputResize)
-	{}
-
-	zpaqout(vector<uint8_t>& buffer)
-		: outputBuffer([&]() { return (uint8_t*)buffer.data(); }),
-		  outputResize([&](size_t size) { buffer.resize(size); })
-	{}
+	zpaqout(vector<uint8_t>& buffer) : buffer(buffer) {}
 
 	void put(int c) override
 	{
-		// should output low 8 bits of c
-		// buffer.push_back((uint8_t)c);
-		outputResize(++pos);
-		outputBuffer()[pos] = (uint8_t)c;
+		buffer.push_back((uint8_t)c);  // low 8 bits of c
 	}
 	void write(const char* buf, int n) override
 	{
-		outputResize(pos += n);
-		copy_n(buf, n, outputBuffer() + pos);
+		buffer.insert(buffer.end(), buf, buf + n);
 	}
 
 private:
-	function<uint8_t*()> outputBuffer;
-	function<void(size_t)> outputResize;
-	size_t pos = 0;
+	vector<uint8_t>& buffer;
 };
 
 inline void
@@ -453,11 +505,10 @@ inline void
 inline void decompressZPAQ(
 	const uint8_t* inputBuffer,
 	const size_t inputSize,
-	function<uint8_t*()> outputBuffer,
-	function<void(size_t)> outputResize)
+	vector<uint8_t>& output)
 {
 	zpaqin zin((char*)inputBuffer, inputSize);
-	zpaqout zout(outputBuffer, outputResize);
+	zpaqout zout(output);
 	libzpaq::decompress(&zin, &zout);
 }
 #endif
@@ -466,12 +517,20 @@ inline void decompressZPAQ(
 template <>
 vector<uint8_t> compress(const uint8_t* data, size_t size, Compression method, int level)
 {
+	TRACE_ZONE("compress");
+	TRACE_COUNT("bytes compressed", size);
+
 	vector<uint8_t> compressed;
 
 	switch (method)
 	{
 		case Compression::Auto:
-			// pick the first enabled method below
+			compressed = compressAuto(data, size, { 0, 0, false });
+			break;
+
+		case Compression::None:
+			compressed.assign(data, data + size);
+			break;
 
 #if defined(ENABLE_ZSTD)
 		case Compression::Zstd:
@@ -520,55 +579,575 @@ vector<uint8_t> compress(const uint8_t* data, size_t size, Compression method, i
 		default:
 			throw invalid_argument("compression method not supported");
 	}
+
+	TRACE_COUNT("compressed bytes written", compressed.size());
 	return compressed;
 }
 
 
-void decompress(
+namespace
+{
+	// codecs and levels Compression::Auto tries, each from fastest to strongest
+	const pair<Compression, int> candidates[] = {
+#if defined(ENABLE_ZSTD)
+		{ Compression::Zstd, 1 },
+		{ Compression::Zstd, 3 },
+		{ Compression::Zstd, 9 },
+		{ Compression::Zstd, 19 },
+#endif
+#if defined(ENABLE_BROTLI)
+		{ Compression::Brotli, 1 },
+		{ Compression::Brotli, 5 },
+		{ Compression::Brotli, 9 },
+		{ Compression::Brotli, 11 },
+#endif
+	};
+
+	// slices spread over the whole data, so a block changing along its length is judged by
+	// more than its beginning
+	vector<uint8_t> sample(const uint8_t* data, size_t size)
+	{
+		const size_t slices = 4;
+		const size_t sliceSize = COMPRESSION_SAMPLE_SIZE / slices;
+		vector<uint8_t> output;
+		for (size_t i = 0; i < slices; i++)
+		{
+			const auto start = (size - sliceSize) * i / (slices - 1);
+			output.insert(output.end(), data + start, data + start + sliceSize);
+		}
+		return output;
+	}
+
+	// MB/s of the fastest of several runs, repeated for at least a millisecond so that small
+	// samples are not lost in the resolution of the clock
+	float decodeSpeed(const vector<uint8_t>& compressed, Compression method, size_t size)
+	{
+		vector<uint8_t> output;
+		double fastest = INFINITY;
+		double total = 0;
+		for (int runs = 0; runs < 3 || (total < 1e-3 && runs < 1000); runs++)
+		{
+			const auto start = chrono::steady_clock::now();
+			decompress(compressed.data(), compressed.size(), output, method);
+			const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+			fastest = min(fastest, elapsed.count());
+			total += elapsed.count();
+		}
+		return float(size / max(fastest, 1e-9) / 1e6);
+	}
+}
+
+vector<uint8_t> compressAuto(
 	const uint8_t* data,
-	const size_t size,
-	function<uint8_t*()> outputBuffer,
-	function<void(size_t)> outputResize,
-	Compression method /*= Compression::Auto*/)
+	size_t size,
+	const CompressionTarget& target,
+	CompressionChoice* choice)
 {
-	if (method == Compression::Auto)
-		method = detectCompression(data, size);
+	TRACE_ZONE("compress/auto");
+
+	const auto whole = size <= COMPRESSION_SAMPLE_SIZE;
+	const auto sampled = whole ? vector<uint8_t>() : sample(data, size);
+	const auto* sampleData = whole ? data : sampled.data();
+	const auto sampleSize = whole ? size : sampled.size();
+
+	vector<CompressionChoice> measured;
+	vector<vector<uint8_t>> outputs;  // kept when the sample is the whole data
+	if (target.allowNone)
+	{
+		measured.push_back({ Compression::None, 0, 1, INFINITY });
+		outputs.emplace_back(data, data + (whole ? size : 0));
+	}
+	for (const auto& [method, level]: candidates)
+	{
+		auto compressed = compress(sampleData, sampleSize, method, level);
+		const auto ratio = sampleSize ? float(compressed.size()) / sampleSize : 1.0f;
+		const auto speed = decodeSpeed(compressed, method, sampleSize);
+		measured.push_back({ method, level, ratio, speed });
+		outputs.push_back(whole ? move(compressed) : vector<uint8_t>());
+	}
+	if (measured.empty())
+		throw invalid_argument("no compression method enabled");
+
+	// Within the size budget the fastest to decode, within the speed budget the smallest;
+	// when nothing meets the budget, whatever comes closest to it
+	const auto sizeBudget = target.maxRatio > 0;
+	size_t best = 0;
+	bool met = false;
+	for (size_t i = 0; i < measured.size(); i++)
+	{
+		const auto& candidate = measured[i];
+		const auto& current = measured[best];
+		const auto meets = sizeBudget ? candidate.ratio <= target.maxRatio
+									  : candidate.decodeSpeed >= target.minDecodeSpeed;
+		const auto faster = candidate.decodeSpeed > current.decodeSpeed;
+		const auto smaller = candidate.ratio < current.ratio;
+		const auto better = sizeBudget == meets ? faster : smaller;
+		if (i == 0 || (meets && !met) || (meets == met && better))
+		{
+			best = i;
+			met = meets;
+		}
+	}
+
+	if (choice)
+		*choice = measured[best];
+	if (whole)
+		return move(outputs[best]);
+	return compress(data, size, measured[best].method, measured[best].level);
+}
 
+const char* compressionName(Compression method)
+{
+	switch (method)
+	{
+		case Compression::Auto:
+			return "auto";
+		case Compression::None:
+			return "none";
+		case Compression::Zstd:
+			return "zstd";
+		case Compression::Brotli:
+			return "brotli";
+		default:
+			return "unknown";
+	}
+}
+
+
+namespace
+{
+	// Contexts of one thread, destroyed before the memory they allocate from
+	struct LocalContexts
+	{
+#if defined(ENABLE_BROTLI)
+		BrotliMemory memory;
+#else
+		int memory;
+#endif
+		map<Compression, unique_ptr<Compressor>> compressors;
+		map<Compression, unique_ptr<Decompressor>> decompressors;
+	};
+
+	thread_local LocalContexts localContexts;
+
+	Compression streamMethod(Compression method)
+	{
+		if (method != Compression::Auto)  // nothing to sample yet
+			return method;
+#if defined(ENABLE_BROTLI)
+		return Compression::Brotli;
+#else
+		return Compression::Zstd;
+#endif
+	}
+}
+
+
+Compressor::Compressor(
+	Compression method,
+	int level,
+	function<void(const uint8_t*, size_t)> output)
+	: method(streamMethod(method)),
+	  output(move(output))
+{
+	reset(level);
+}
+
+Compressor::Compressor(Compression method, void* memory) : method(method), memory(memory) {}
+
+Compressor::~Compressor()
+{
 	switch (method)
 	{
 #if defined(ENABLE_ZSTD)
 		case Compression::Zstd:
-			return decompressZstd(data, size, outputBuffer, outputResize);
+			ZSTD_freeCCtx((ZSTD_CCtx*)state);
+			break;
 #endif
+#if defined(ENABLE_BROTLI)
+		case Compression::Brotli:
+			BrotliEncoderDestroyInstance((BrotliEncoderState*)state);
+			break;
+#endif
+		default:
+			break;
+	}
+}
 
-#if defined(ENABLE_LIBDEFLATE)
-		case Compression::Deflate:
-		case Compression::zlib:
-		case Compression::gzip:
-			return decompressDeflate(data, size, outputBuffer, outputResize);
+Compressor& Compressor::local(
+	Compression method,
+	int level,
+	const uint8_t* dictionary,
+	size_t dictionarySize)
+{
+	auto& compressor = localContexts.compressors[method];
+	if (!compressor)
+		compressor.reset(new Compressor(method, &localContexts.memory));
+	compressor->reset(level, dictionary, dictionarySize);
+	return *compressor;
+}
+
+void Compressor::reset(int level, const uint8_t* dictionary, size_t dictionarySize)
+{
+	(void)dictionarySize;  // only Zstd loads it
+
+	switch (method)
+	{
+#if defined(ENABLE_ZSTD)
+		case Compression::Zstd:
+		{
+			if (!state)
+				state = ZSTD_createCCtx();
+			auto context = (ZSTD_CCtx*)state;
+			ZSTD_CCtx_reset(context, ZSTD_reset_session_and_parameters);
+			ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level);
+			if (dictionary
+				&& ZSTD_isError(ZSTD_CCtx_loadDictionary(context, dictionary, dictionarySize)))
+				throw runtime_error("ZSTD_CCtx_loadDictionary failed");
+			return;
+		}
+#endif
+
+#if defined(ENABLE_BROTLI)
+		case Compression::Brotli:
+		{
+			if (dictionary)
+				throw invalid_argument("dictionaries need Zstd");
+			BrotliEncoderDestroyInstance((BrotliEncoderState*)state);
+			auto encoder = memory ? BrotliEncoderCreateInstance(
+										BrotliMemory::allocate,
+										BrotliMemory::release,
+										memory)
+								  : BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+			BrotliEncoderSetParameter(
+				encoder,
+				BROTLI_PARAM_QUALITY,
+				min(level, BROTLI_MAX_QUALITY));
+			state = encoder;
+			return;
+		}
+#endif
+
+		default:
+			throw invalid_argument("streaming compression method not supported");
+	}
+}
+
+bool Compressor::run(
+	const uint8_t*& input,
+	size_t& inputSize,
+	uint8_t*& output,
+	size_t& outputSize,
+	bool end)
+{
+	switch (method)
+	{
+#if defined(ENABLE_ZSTD)
+		case Compression::Zstd:
+		{
+			ZSTD_inBuffer in { input, inputSize, 0 };
+			ZSTD_outBuffer out { output, outputSize, 0 };
+			size_t remaining;
+			do
+			{
+				remaining = ZSTD_compressStream2(
+					(ZSTD_CCtx*)state,
+					&out,
+					&in,
+					end ? ZSTD_e_end : ZSTD_e_continue);
+				if (ZSTD_isError(remaining))
+					throw runtime_error("ZSTD_compressStream2 failed");
+			} while (out.pos < out.size && (end ? remaining != 0 : in.pos < in.size));
+
+			input += in.pos;
+			inputSize -= in.pos;
+			output += out.pos;
+			outputSize -= out.pos;
+			return !inputSize && (!end || remaining == 0);
+		}
 #endif
 
 #if defined(ENABLE_BROTLI)
 		case Compression::Brotli:
-			return decompressBrotli(data, size, outputBuffer, outputResize);
+		{
+			auto encoder = (BrotliEncoderState*)state;
+			const auto operation = end ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS;
+			auto pending = [&]()
+			{
+				return inputSize || BrotliEncoderHasMoreOutput(encoder)
+					|| (end && !BrotliEncoderIsFinished(encoder));
+			};
+			do
+			{
+				if (!BrotliEncoderCompressStream(
+						encoder,
+						operation,
+						&inputSize,
+						&input,
+						&outputSize,
+						&output,
+						nullptr))
+					throw runtime_error("BrotliEncoderCompressStream failed");
+			} while (outputSize && pending());
+			return !pending();
+		}
+#endif
+
+		default:
+			throw invalid_argument("streaming compression method not supported");
+	}
+}
+
+void Compressor::drain(const uint8_t* data, size_t size, bool end)
+{
+	uint8_t buffer[1 << 16];
+	bool done;
+	do
+	{
+		auto* next = buffer;
+		auto available = sizeof(buffer);
+		done = run(data, size, next, available, end);
+		if (next != buffer)
+		{
+			TRACE_COUNT("compressed bytes written", next - buffer);
+			output(buffer, next - buffer);
+		}
+	} while (!done);
+}
+
+void Compressor::write(const uint8_t* data, size_t size)
+{
+	TRACE_ZONE("compress");
+	TRACE_COUNT("bytes compressed", size);
+	drain(data, size, false);
+}
+
+void Compressor::finish()
+{
+	TRACE_ZONE("compress");
+	drain(nullptr, 0, true);
+}
+
+
+// Methods without a streaming decoder, which Decompressor::run() decodes at once
+inline void decompressWhole(
+	Compression method,
+	const uint8_t* input,
+	size_t size,
+	vector<uint8_t>& output)
+{
+	(void)input, (void)size, (void)output;  // unused when none of them is enabled
+
+	switch (method)
+	{
+#if defined(ENABLE_LIBDEFLATE)
+		case Compression::Deflate:
+		case Compression::zlib:
+		case Compression::gzip:
+			return decompressDeflate(input, size, output);
 #endif
 
 #if defined(ENABLE_LZMA2)
 		case Compression::LZMA2:
-			return decompressLZMA2(data, size, outputBuffer, outputResize);
+			return decompressLZMA2(input, size, output);
 #endif
 
 #if defined(ENABLE_SNAPPY)
 		case Compression::Snappy:
-			return decompressSnappy(data, size, outputBuffer, outputResize);
+			return decompressSnappy(input, size, output);
 #endif
 
 #if defined(ENABLE_ZPAQ)
 		case Compression::ZPAQ:
-			return decompressZPAQ(data, size, outputBuffer, outputResize);
+			return decompressZPAQ(input, size, output);
 #endif
 
 		default:
-			throw invalid_argument("compression method not supported");
+			throw invalid_argument("decompression method not supported");
+	}
+}
+
+Decompressor::Decompressor(Compression method) : method(method)
+{
+	reset();
+}
+
+Decompressor::Decompressor(Compression method, void* memory) : method(method), memory(memory) {}
+
+Decompressor::~Decompressor()
+{
+	switch (method)
+	{
+#if defined(ENABLE_ZSTD)
+		case Compression::Zstd:
+			ZSTD_freeDCtx((ZSTD_DCtx*)state);
+			break;
+#endif
+#if defined(ENABLE_BROTLI)
+		case Compression::Brotli:
+			BrotliDecoderDestroyInstance((BrotliDecoderState*)state);
+			break;
+#endif
+		default:
+			break;
+	}
+}
+
+Decompressor& Decompressor::local(
+	Compression method,
+	const uint8_t* dictionary,
+	size_t dictionarySize)
+{
+	auto& decompressor = localContexts.decompressors[method];
+	if (!decompressor)
+		decompressor.reset(new Decompressor(method, &localContexts.memory));
+	decompressor->reset(dictionary, dictionarySize);
+	return *decompressor;
+}
+
+void Decompressor::reset(const uint8_t* dictionary, size_t dictionarySize)
+{
+	(void)dictionarySize;  // only Zstd loads it
+	if (dictionary && method != Compression::Zstd)
+		throw invalid_argument("dictionaries need Zstd");
+
+	switch (method)
+	{
+		case Compression::None:
+			return;
+
+#if defined(ENABLE_ZSTD)
+		case Compression::Zstd:
+		{
+			if (!state)
+				state = ZSTD_createDCtx();
+			auto context = (ZSTD_DCtx*)state;
+			ZSTD_DCtx_reset(context, ZSTD_reset_session_and_parameters);
+			if (dictionary
+				&& ZSTD_isError(ZSTD_DCtx_loadDictionary(context, dictionary, dictionarySize)))
+				throw runtime_error("ZSTD_DCtx_loadDictionary failed");
+			return;
+		}
+#endif
+
+#if defined(ENABLE_BROTLI)
+		case Compression::Brotli:
+			BrotliDecoderDestroyInstance((BrotliDecoderState*)state);
+			state = memory ? BrotliDecoderCreateInstance(
+								 BrotliMemory::allocate,
+								 BrotliMemory::release,
+								 memory)
+						   : BrotliDecoderCreateInstance(nullptr, nullptr, nullptr);
+			return;
+#endif
+
+		default:
+			// methods that cannot stream; run() throws for those not enabled
+			decoded.clear();
+			decodedOffset = 0;
+			return;
 	}
 }
+
+bool Decompressor::run(
+	const uint8_t*& input,
+	size_t& inputSize,
+	uint8_t*& output,
+	size_t& outputSize)
+{
+	switch (method)
+	{
+#if defined(ENABLE_ZSTD)
+		case Compression::Zstd:
+		{
+			ZSTD_inBuffer in { input, inputSize, 0 };
+			ZSTD_outBuffer out { output, outputSize, 0 };
+			size_t remaining;
+			do
+			{
+				remaining = ZSTD_decompressStream((ZSTD_DCtx*)state, &out, &in);
+				if (ZSTD_isError(remaining))
+					throw runtime_error("ZSTD_decompressStream failed");
+			} while (remaining && out.pos < out.size && in.pos < in.size);
+
+			input += in.pos;
+			inputSize -= in.pos;
+			output += out.pos;
+			outputSize -= out.pos;
+			return remaining == 0;
+		}
+#endif
+
+#if defined(ENABLE_BROTLI)
+		case Compression::Brotli:
+		{
+			const auto result = BrotliDecoderDecompressStream(
+				(BrotliDecoderState*)state,
+				&inputSize,
+				&input,
+				&outputSize,
+				&output,
+				nullptr);
+			if (result == BROTLI_DECODER_RESULT_ERROR)
+				throw runtime_error("BrotliDecoderDecompressStream failed");
+			return result == BROTLI_DECODER_RESULT_SUCCESS;
+		}
+#endif
+
+		case Compression::None:
+		{
+			const auto size = min(inputSize, outputSize);
+			copy_n(input, size, output);
+			input += size;
+			inputSize -= size;
+			output += size;
+			outputSize -= size;
+			return inputSize == 0;
+		}
+
+		default:
+		{
+			// the first call decodes everything, the following ones copy out the rest
+			if (decoded.empty())
+			{
+				decompressWhole(method, input, inputSize, decoded);
+				input += inputSize;
+				inputSize = 0;
+			}
+			const auto size = min(decoded.size() - decodedOffset, outputSize);
+			copy_n(decoded.data() + decodedOffset, size, output);
+			decodedOffset += size;
+			output += size;
+			outputSize -= size;
+			return decodedOffset == decoded.size();
+		}
+	}
+}
+
+size_t Decompressor::decodedSize(const uint8_t* input, size_t inputSize) const
+{
+	(void)input;  // only Zstd reads its header
+
+	switch (method)
+	{
+		case Compression::None:
+			return inputSize;
+
+#if defined(ENABLE_ZSTD)
+		case Compression::Zstd:
+		{
+			const auto size = ZSTD_getFrameContentSize(input, inputSize);
+			if (size == ZSTD_CONTENTSIZE_ERROR)
+				throw runtime_error("ZSTD_getFrameContentSize failed");
+			if (size != ZSTD_CONTENTSIZE_UNKNOWN)
+				return size;
+			return max<size_t>(inputSize * 4, 1024);
+		}
+#endif
+
+		default:
+			// Brotli does not store it
+			return max<size_t>(inputSize * 20, 1024);
+	}
+}
+
@@ -1,13 +1,17 @@
 #pragma once
 
+#include "Trace.h"
+#include <algorithm>
 #include <functional>
+#include <stdexcept>
 #include <vector>
 #include <stdint.h>
 
 
 enum class Compression {
 	Auto,
-	// Zstd,
+	None,  // stored as is
+	Zstd,  // needs ENABLE_ZSTD
 	// Deflate,
 	// zlib,
 	// gzip,
@@ -42,11 +46,13 @@ inline std::vector<uint8_t> compress(
 
 
 
+// Decode all of `input` into `output`, replacing what it held. The decoded bytes must make a
+// whole number of elements. Auto detects every method but Compression::None.
+template <class Type>
 void decompress(
-	const uint8_t* inputBuffer,
-	const size_t inputSize,
-	std::function<uint8_t*()> outputBuffer,
-	std::function<void(size_t)> outputResize,
+	const uint8_t* input,
+	size_t inputSize,
+	std::vector<Type>& output,
 	Compression method = Compression::Auto);
 
 template <class OutputType = uint8_t, template <class, class...> class Container, class... Rest>
@@ -55,12 +61,7 @@ std::vector<OutputType> decompress(
 	Compression method = Compression::Auto)
 {
 	std::vector<OutputType> outputBuffer;
-	decompress(
-		compressedBuffer.data(),
-		compressedBuffer.size(),
-		[&]() { return (uint8_t*)outputBuffer.data(); },                       // data
-		[&](size_t size) { outputBuffer.resize(size / sizeof(OutputType)); },  // resize
-		method);
+	decompress(compressedBuffer.data(), compressedBuffer.size(), outputBuffer, method);
 	return outputBuffer;
 }
 
@@ -71,11 +72,204 @@ std::vector<OutputType> decompress(
 	Compression method = Compression::Auto)
 {
 	std::vector<OutputType> outputBuffer;
-	decompress(
-		inputBuffer,
-		inputSize,
-		[&]() { return (uint8_t*)outputBuffer.data(); },                       // data
-		[&](size_t size) { outputBuffer.resize(size / sizeof(OutputType)); },  // resize
-		method);
+	decompress(inputBuffer, inputSize, outputBuffer, method);
 	return outputBuffer;
 }
+
+// The method a compressed stream was written with, as far as its first bytes tell
+Compression detectCompression(const uint8_t* data, size_t size);
+
+// What Compression::Auto aims for. It compresses a sample of the data with every enabled
+// codec at a few levels and times decoding each result. With maxRatio set, it takes the
+// fastest decoding output no larger than that fraction of the input; otherwise the smallest
+// output decoding at least minDecodeSpeed, so 0 asks for the best ratio at any speed.
+struct CompressionTarget
+{
+	float minDecodeSpeed = 0;  // MB/s of decompressed data
+	float maxRatio = 0;        // compressed / uncompressed size
+
+	// whether Compression::None is a candidate; decompress() cannot detect it, so data
+	// stored as is must be marked as such by the caller
+	bool allowNone = true;
+};
+
+struct CompressionChoice
+{
+	Compression method = Compression::None;
+	int level = 0;
+	float ratio = 1;        // as measured on the sample
+	float decodeSpeed = 0;  // MB/s, infinite for Compression::None
+};
+
+#define COMPRESSION_SAMPLE_SIZE (64 * 1024)
+
+// Compress with the codec and level meeting `target`, reported in `choice`. compress() does
+// the same for Compression::Auto, without Compression::None and ignoring the level.
+std::vector<uint8_t> compressAuto(
+	const uint8_t* data,
+	size_t size,
+	const CompressionTarget& target,
+	CompressionChoice* choice = nullptr);
+
+const char* compressionName(Compression method);
+
+
+// Compresses data handed over in pieces, passing compressed bytes to `output` as they are
+// produced, so neither side has to be held in memory at once. Without `output`, run() fills
+// buffers of the caller instead.
+class Compressor
+{
+public:
+	Compressor(
+		Compression method,
+		int level,
+		std::function<void(const uint8_t*, size_t)> output = nullptr);
+	~Compressor();
+
+	Compressor(const Compressor&) = delete;
+	Compressor& operator=(const Compressor&) = delete;
+
+	void write(const uint8_t* data, size_t size);
+	void finish();  // flushes everything, nothing can be written afterwards
+
+	// Compress as much of the input as fits in the output, advancing both. With `end`, the
+	// input is the last of the stream. Returns true once all of it is output, otherwise call
+	// again with more room.
+	bool run(
+		const uint8_t*& input,
+		size_t& inputSize,
+		uint8_t*& output,
+		size_t& outputSize,
+		bool end);
+
+	// start another stream; a dictionary (Zstd only) must outlive it
+	void reset(int level, const uint8_t* dictionary = nullptr, size_t dictionarySize = 0);
+
+	// The compressor of the calling thread for `method`, reset for a new stream. It keeps its
+	// context between streams, so compressing many small blocks pays the setup once.
+	static Compressor& local(
+		Compression method,
+		int level,
+		const uint8_t* dictionary = nullptr,
+		size_t dictionarySize = 0);
+
+private:
+	Compressor(Compression method, void* memory);
+	void drain(const uint8_t* data, size_t size, bool end);
+
+	const Compression method;
+	std::function<void(const uint8_t*, size_t)> output;
+	void* state = nullptr;
+	void* memory = nullptr;  // allocations cached by the owning thread, for local() ones
+};
+
+// Counterpart of Compressor, decoding into buffers of the caller
+class Decompressor
+{
+public:
+	Decompressor(Compression method);
+	~Decompressor();
+
+	Decompressor(const Decompressor&) = delete;
+	Decompressor& operator=(const Decompressor&) = delete;
+
+	// Decode as much of the input as fits in the output, advancing both. Returns true once
+	// the stream is complete; false with output room left means the input is cut short.
+	bool run(const uint8_t*& input, size_t& inputSize, uint8_t*& output, size_t& outputSize);
+
+	// Decode the whole input into `output`, growing it in whole elements as needed and
+	// trimming it to the decoded size
+	template <class Type>
+	void runAll(const uint8_t* input, size_t inputSize, std::vector<Type>& output);
+
+	void reset(const uint8_t* dictionary = nullptr, size_t dictionarySize = 0);
+
+	static Decompressor& local(
+		Compression method,
+		const uint8_t* dictionary = nullptr,
+		size_t dictionarySize = 0);
+
+private:
+	Decompressor(Compression method, void* memory);
+
+	// bytes runAll() starts from: the size in the stream header if it has one, else a guess
+	size_t decodedSize(const uint8_t* input, size_t inputSize) const;
+
+	const Compression method;
+	void* state = nullptr;
+	void* memory = nullptr;
+
+	// output of the methods that cannot stream, decoded at once and handed out by run()
+	std::vector<uint8_t> decoded;
+	size_t decodedOffset = 0;
+};
+
+template <class Type>
+void Decompressor::runAll(const uint8_t* input, size_t inputSize, std::vector<Type>& output)
+{
+	auto capacity = decodedSize(input, inputSize);
+	size_t actualSize = 0;
+	while (true)
+	{
+		// the decoder only gets the bytes of whole elements, so it never writes past them
+		output.resize((capacity + sizeof(Type) - 1) / sizeof(Type));
+		capacity = output.size() * sizeof(Type);
+		auto space = capacity - actualSize;
+		auto* next = (uint8_t*)output.data() + actualSize;
+		const auto finished = run(input, inputSize, next, space);
+		actualSize = capacity - space;
+		if (finished)
+			break;
+		if (space)
+			throw std::runtime_error("compressed data is truncated");
+		capacity = std::max<size_t>(capacity * 2, 1024);
+	}
+	if (actualSize % sizeof(Type))
+		throw std::runtime_error("decompressed size is not a whole number of elements");
+	output.resize(actualSize / sizeof(Type));
+}
+
+template <class Type>
+void decompress(
+	const uint8_t* input,
+	size_t inputSize,
+	std::vector<Type>& output,
+	Compression method /*= Compression::Auto*/)
+{
+	TRACE_ZONE("decompress");
+	TRACE_COUNT("compressed bytes read", inputSize);
+
+	if (method == Compression::Auto)
+		method = detectCompression(input, inputSize);
+	Decompressor::local(method).runAll(input, inputSize, output);
+}
+
+
+// Zstd dictionaries (ENABLE_ZSTD, throw otherwise). Blocks of a few hundred bytes compress
+// poorly on their own; a dictionary trained from samples of them gives them the shared
+// context of one large block while each stays decompressible on its own.
+std::vector<uint8_t> trainDictionary(
+	const std::vector<std::vector<uint8_t>>& samples,
+	size_t capacity = 16 * 1024);
+
+std::vector<uint8_t> compressWithDictionary(
+	const uint8_t* data,
+	size_t size,
+	const uint8_t* dictionary,
+	size_t dictionarySize,
+	int level = 19);
+
+template <class Type>
+void decompressWithDictionary(
+	const uint8_t* input,
+	size_t inputSize,
+	const uint8_t* dictionary,
+	size_t dictionarySize,
+	std::vector<Type>& output)
+{
+	TRACE_ZONE("decompress");
+	TRACE_COUNT("compressed bytes read", inputSize);
+
+	Decompressor::local(Compression::Zstd, dictionary, dictionarySize)
+		.runAll(input, inputSize, output);
+}
@@ -1,8 +1,17 @@
 #pragma once
 
+#include "Compression.h"
+#include "Parallel.h"
+#include <array>
 #include <filesystem>
 #include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 
@@ -12,7 +21,7 @@ public:
 	File(const std::filesystem::path& filename, const std::string& mode)
 	{
 		// make sure path exists so we can actually create file
-		if (mode.find('w') != std::string::npos)
+		if (mode.find('w') != std::string::npos && filename.has_parent_path())
 			std::filesystem::create_directories(filename.parent_path());
 		handle = fopen(filename.c_str(), mode.c_str());
 	}
@@ -47,7 +56,6 @@ public:
 	template <class Type>
 	static void writeAll(const Type* data, size_t size, const std::filesystem::path& filename)
 	{
-		std::filesystem::create_directories(filename.parent_path());
 		File file(filename, "wb");
 		fwrite(data, sizeof(Type), size, file);
 	}
@@ -66,6 +74,28 @@ public:
 
 
 
+	// Read-only view of a whole file, paged in by the OS on demand
+	class Mapping
+	{
+	public:
+		Mapping(const std::filesystem::path& filename);
+		~Mapping();
+
+		Mapping(const Mapping&) = delete;
+		Mapping& operator=(const Mapping&) = delete;
+
+		const uint8_t* data() const { return address; }
+		size_t size() const { return length; }
+
+	private:
+		const uint8_t* address = nullptr;
+		size_t length = 0;
+	};
+
+
+
+	// Named blocks in one file. In 'r' mode the file is mapped and the block table never
+	// changes after opening, so any number of threads can get() from the same pack.
 	class Pack
 	{
 	public:
@@ -102,19 +132,124 @@ public:
 		}
 
 
+		// Train a Zstd dictionary from samples of small blocks and store it as block `name`.
+		// Compressed blocks added afterwards, until clearDictionary(), are compressed against
+		// it, so that each can be read on its own without losing the ratio of one large block.
+		// Needs ENABLE_ZSTD.
+		void addDictionary(
+			const std::string& name,
+			const std::vector<std::vector<uint8_t>>& samples,
+			size_t capacity = 16 * 1024);
+		void clearDictionary();
+
+		// Compress blocks added afterwards, until clearCompressionTarget(), with the codec and
+		// level that Compression::Auto finds best for `target` on each of them: fast loads for
+		// runtime packs, small files for archives. The descriptor records the choice, which is
+		// also printed. A compression level of 0 still stores blocks as they are; dictionaries
+		// take precedence, and streamed blocks stay Brotli.
+		void setCompressionTarget(const CompressionTarget& target);
+		void clearCompressionTarget();
+
+		// Copy a block of another pack as it is stored, without decompressing it, naming it
+		// prefix + name; a dictionary it was compressed against must be copied the same way
+		void copy(const Pack& source, const std::string& name, const std::string& prefix);
+
+		// Block written piece by piece and compressed on the fly, for data too large to hold
+		// in memory at once. No other block can be added until it is finished.
+		class Stream
+		{
+		public:
+			Stream(Pack& pack, const std::string& name, const char* typeinfo, int compression);
+			~Stream();
+
+			Stream(const Stream&) = delete;
+			Stream& operator=(const Stream&) = delete;
+
+			void write(const void* data, size_t size);
+			void finish();
+
+		private:
+			void append(const uint8_t* data, size_t size);
+
+			Pack& pack;
+			size_t block;
+			std::unique_ptr<Compressor> compressor;
+			bool open = true;
+		};
+
 		template <class Type>
-		std::vector<Type> get(const std::string& name)
+		std::unique_ptr<Stream> addStream(const std::string& name, int compression = 5)
 		{
-			std::vector<Type> outputBuffer;
-			get(
-				name,
-				[&]() { return (uint8_t*)outputBuffer.data(); },                // data
-				[&](size_t size) { outputBuffer.resize(size / sizeof(Type)); }  // resize
-			);
-			return outputBuffer;
+			return std::make_unique<Stream>(*this, name, typeid(Type).name(), compression);
+		}
+
+
+		std::vector<std::string> names() const;
+
+		template <class Type>
+		std::vector<Type> get(const std::string& name) const
+		{
+			TRACE_ZONE("pack/get");
+
+			const auto* block = find(name);
+			if (!block)
+				throw std::runtime_error("Block not found");
+
+			std::vector<uint8_t> buffer;
+			const auto* data = stored(*block, buffer);
+			std::vector<Type> output;
+			const Block* dictionary;
+			const auto method = decoding(*block, dictionary);
+			if (dictionary)
+			{
+				std::vector<uint8_t> dictionaryBuffer;
+				decompressWithDictionary(
+					data,
+					block->compressedSize,
+					stored(*dictionary, dictionaryBuffer),
+					dictionary->compressedSize,
+					output);
+			}
+			else
+				decompress(data, block->compressedSize, output, method);
+			return output;
+		}
+
+		// Fetch several blocks at once, decompressing them concurrently on the Parallel pool
+		// in 'r' mode:
+		//     auto [vertices, indices] = pack.getMany<float2, uint32_t>({ "vert", "idx" });
+		template <class... Types>
+		std::tuple<std::vector<Types>...> getMany(
+			const std::array<std::string, sizeof...(Types)>& names)
+		{
+			std::tuple<std::vector<Types>...> output;
+			getMany(names, output, std::index_sequence_for<Types...>());
+			return output;
 		}
 
 	private:
+		template <class Tuple, size_t... I>
+		void getMany(
+			const std::array<std::string, sizeof...(I)>& names,
+			Tuple& output,
+			std::index_sequence<I...>)
+		{
+			const std::function<void()> tasks[] = {
+				[&]() { getInto(names[I], std::get<I>(output)); }...
+			};
+			if (mapping)
+				Parallel::forEach(sizeof...(I), [&](size_t i) { tasks[i](); });
+			else
+				for (auto& task: tasks)
+					task();
+		}
+
+		template <class Type>
+		void getInto(const std::string& name, std::vector<Type>& output) const
+		{
+			output = get<Type>(name);
+		}
+
 		struct Block
 		{
 			std::string name;
@@ -127,17 +262,24 @@ public:
 		void flush();
 
 		Block* find(const std::string& name);
-		void get(
-			const std::string& name,
-			std::function<uint8_t*()> outputBuffer,
-			std::function<void(size_t)> outputResize);
+		const Block* find(const std::string& name) const;
+		// Compression::None for raw blocks; "zstd:" ones also get their dictionary block
+		Compression decoding(const Block& block, const Block*& dictionary) const;
+		const uint8_t* stored(const Block& block, std::vector<uint8_t>& buffer) const;
 
 
 		std::vector<Block> blocks;
+		std::unordered_map<std::string, size_t> index;  // of blocks by name
 
-		std::unique_ptr<File> file;
+		std::unique_ptr<File> file;        // when writing
+		std::unique_ptr<Mapping> mapping;  // when reading
 		size_t currentWritePosition = 0;
 		bool dirty = false;
+		bool streaming = false;  // a Stream is open
+
+		std::string dictionaryName;  // compressing new blocks against it when not empty
+		std::vector<uint8_t> dictionary;
+		std::optional<CompressionTarget> compressionTarget;
 
 		struct
 		{
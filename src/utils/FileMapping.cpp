@@ -0,0 +1,88 @@
+#include "File.h"
+#include <stdexcept>
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+using namespace std;
+
+
+#if defined(_WIN32)
+
+File::Mapping::Mapping(const filesystem::path& filename)
+{
+	auto file = CreateFileW(
+		filename.c_str(),
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		nullptr,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL,
+		nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw runtime_error("Unable to open file");
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	length = (size_t)fileSize.QuadPart;
+
+	if (length)
+	{
+		auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping)
+		{
+			address = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+
+	if (length && !address)
+		throw runtime_error("Unable to map file");
+}
+
+File::Mapping::~Mapping()
+{
+	if (address)
+		UnmapViewOfFile(address);
+}
+
+#else
+
+File::Mapping::Mapping(const filesystem::path& filename)
+{
+	const int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw runtime_error("Unable to open file");
+
+	struct stat info;
+	if (fstat(fd, &info) == 0)
+		length = (size_t)info.st_size;
+
+	if (length)
+	{
+		auto mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped != MAP_FAILED)
+			address = (const uint8_t*)mapped;
+	}
+	close(fd);
+
+	if (length && !address)
+		throw runtime_error("Unable to map file");
+}
+
+File::Mapping::~Mapping()
+{
+	if (address)
+		munmap((void*)address, length);
+}
+
+#endif
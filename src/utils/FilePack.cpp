@@ -1,6 +1,8 @@
 
 #include "File.h"
 #include "Compression.h"
+#include "Trace.h"
+#include <cstring>
 #include <regex>
 #include <sstream>
 
@@ -33,55 +35,64 @@ string demangle(const char* name)
 #endif
 
 
+// "brotli", or "brotli/11" for a level picked by Compression::Auto
+Compression storedMethod(const string& compression)
+{
+	const auto name = compression.substr(0, compression.find('/'));
+	for (auto method: { Compression::Zstd, Compression::Brotli })
+		if (name == compressionName(method))
+			return method;
+	return Compression::Auto;  // detected from the data
+}
+
+
 File::Pack::Pack(const filesystem::path& filename, const char mode, const char signature[6])
 	: filename(filename),
 	  mode(mode)
 {
+	TRACE_ZONE("pack/open");
+
 	// modes to support: r, w, a, x
 	// r: read, w: write, a: append, x: write but fail if exists
 
 	if (mode == 'x' && filesystem::exists(filename))
 		throw runtime_error("File exists");
 
-	file = make_unique<File>(filename, string(1, mode));
-	if (!*file)
-		throw runtime_error("Unable to open file");
-
 	if (mode == 'r')  // or if a is  || mode == 'a')
 	{
 		// TODO: append to empty file should be valid
-		const auto size = file->size();
+		mapping = make_unique<Mapping>(filename);
+		const auto size = mapping->size();
 
 		if (size < sizeof(header))
 			throw runtime_error("Invalid file size");
-		fread(&header, sizeof(header), 1, *file);
+		memcpy(&header, mapping->data(), sizeof(header));
 
 		if (memcmp(header.signature, signature, 6) != 0)
 			throw runtime_error("Invalid signature");
+		if (header.descriptorOffset < sizeof(header) || header.descriptorOffset > size)
+			throw runtime_error("Invalid descriptor offset");
 
 		vector<char> descriptors;
-		fseek(*file, header.descriptorOffset, SEEK_SET);
+		const auto* stored = mapping->data() + header.descriptorOffset;
+		const auto storedSize = size - header.descriptorOffset;
 
 		if (header.version == 0)
-		{
-			descriptors.resize(size - header.descriptorOffset);
-			fread(descriptors.data(), 1, descriptors.size(), *file);
-		}
+			descriptors.assign(stored, stored + storedSize);
 		else if (header.version == 1)
-		{
-			vector<uint8_t> compressed(size - header.descriptorOffset);
-			fread(compressed.data(), 1, compressed.size(), *file);
-			descriptors = decompress<char>(compressed);
-		}
+			descriptors = decompress<char>(stored, storedSize);
 		else
 			throw runtime_error("Invalid version");
 
 		auto offset = sizeof(header);
 
 		regex pattern("([^;]*);([^;]*);(\\d+);([^\\n]*)\\s*");
-		for (sregex_token_iterator
-				 i(descriptors.begin(), descriptors.end(), pattern, { 1, 2, 3, 4 });
-			 i != sregex_token_iterator();
+		for (cregex_token_iterator i(
+				 descriptors.data(),
+				 descriptors.data() + descriptors.size(),
+				 pattern,
+				 { 1, 2, 3, 4 });
+			 i != cregex_token_iterator();
 			 i++)
 		{
 			auto& block = blocks.emplace_back();
@@ -91,13 +102,20 @@ File::Pack::Pack(const filesystem::path& filename, const char mode, const char s
 			block.compressedSize = (size_t)stoull((++i)->str());
 			block.name = (++i)->str();
 
-			if (find(block.name) != &block)
+			if (!index.emplace(block.name, blocks.size() - 1).second)
 				throw runtime_error("Block already exists");
 
 			offset += block.compressedSize;
+			if (offset > header.descriptorOffset)
+				throw runtime_error("Invalid block size");
 		}
+		return;
 	}
 
+	file = make_unique<File>(filename, string(1, mode));
+	if (!*file)
+		throw runtime_error("Unable to open file");
+
 	if (mode == 'w' || mode == 'x')  // mode=='a' and file is empty
 	{
 		copy_n(signature, 6, header.signature);
@@ -109,35 +127,49 @@ File::Pack::Pack(const filesystem::path& filename, const char mode, const char s
 
 File::Pack::Block* File::Pack::find(const string& name)
 {
-	for (auto& block: blocks)
-		if (block.name == name)
-			return &block;
+	const auto found = index.find(name);
+	return found != index.end() ? &blocks[found->second] : nullptr;
+}
 
-	return nullptr;
+const File::Pack::Block* File::Pack::find(const string& name) const
+{
+	return const_cast<Pack*>(this)->find(name);
 }
 
-void File::Pack::get(
-	const string& name,
-	function<uint8_t*()> outputBuffer,
-	function<void(size_t)> outputResize)
+vector<string> File::Pack::names() const
 {
-	auto block = find(name);
-	if (!block)
-		throw runtime_error("Block not found");
+	vector<string> names;
+	for (const auto& block: blocks)
+		names.push_back(block.name);
+	return names;
+}
 
-	if (block->compression.empty())
-	{
-		outputResize(block->compressedSize);
-		fseek(*file, block->offset, SEEK_SET);
-		fread(outputBuffer(), block->compressedSize, 1, *file);
-	}
-	else
+Compression File::Pack::decoding(const Block& block, const Block*& dictionary) const
+{
+	dictionary = nullptr;
+	if (block.compression.empty())
+		return Compression::None;
+	if (block.compression.compare(0, 5, "zstd:") == 0)
 	{
-		vector<uint8_t> buffer(block->compressedSize);
-		fseek(*file, block->offset, SEEK_SET);
-		fread(buffer.data(), buffer.size(), 1, *file);
-		decompress(buffer.data(), buffer.size(), outputBuffer, outputResize);
+		dictionary = find(block.compression.substr(5));
+		if (!dictionary)
+			throw runtime_error("Dictionary not found");
+		return Compression::Zstd;
 	}
+	return storedMethod(block.compression);
+}
+
+// Bytes of a block as they are in the file. Mapped packs point into the mapping, where
+// nothing shared changes, so threads can read concurrently; others read into `buffer`.
+const uint8_t* File::Pack::stored(const Block& block, vector<uint8_t>& buffer) const
+{
+	if (mapping)
+		return mapping->data() + block.offset;
+
+	buffer.resize(block.compressedSize);
+	fseek(*file, block.offset, SEEK_SET);
+	fread(buffer.data(), buffer.size(), 1, *file);
+	return buffer.data();
 }
 
 
@@ -149,17 +181,54 @@ void File::Pack::add(
 	int compression,
 	const char* typeinfo)
 {
+	TRACE_ZONE("pack/add");
+
+	if (!file)
+		throw runtime_error("Pack is not open for writing");
 	if (find(name) != nullptr)
 		throw runtime_error("Block already exists");
+	if (streaming)
+		throw runtime_error("Another block is being streamed");
 
+	index.emplace(name, blocks.size());
 	auto& block = blocks.emplace_back();
 	block.name = name;
-	block.typeinfo = demangle(typeinfo);
+	// bytes added directly come without a type
+	block.typeinfo = demangle(typeinfo ? typeinfo : typeid(uint8_t).name());
 	block.offset = currentWritePosition;
 
 	fseek(*file, block.offset, SEEK_SET);
 
-	if (compression)
+	if (compression && !dictionaryName.empty())
+	{
+		auto compressed =
+			compressWithDictionary(data, size, dictionary.data(), dictionary.size(), compression);
+		block.compression = "zstd:" + dictionaryName;
+		block.compressedSize = compressed.size();
+		fwrite(compressed.data(), compressed.size(), 1, *file);
+	}
+	else if (compression && compressionTarget)
+	{
+		CompressionChoice choice;
+		auto compressed = compressAuto(data, size, *compressionTarget, &choice);
+		if (choice.method != Compression::None)
+			block.compression =
+				string(compressionName(choice.method)) + "/" + to_string(choice.level);
+		block.compressedSize = compressed.size();
+		fwrite(compressed.data(), compressed.size(), 1, *file);
+
+		if (choice.method == Compression::None)
+			printf("Block '%s': %zu bytes stored as is\n", name.c_str(), size);
+		else
+			printf(
+				"Block '%s': %s, %zu bytes to %.1f%%, decoding at %.0f MB/s\n",
+				name.c_str(),
+				block.compression.c_str(),
+				size,
+				size ? 100.0 * block.compressedSize / size : 100.0,
+				choice.decodeSpeed);
+	}
+	else if (compression)
 	{
 		auto compressed = compress(data, size, Compression::Brotli, compression);
 		block.compression = "brotli";
@@ -174,6 +243,148 @@ void File::Pack::add(
 
 	currentWritePosition += block.compressedSize;
 	dirty = true;
+
+	TRACE_COUNT("pack bytes written", block.compressedSize);
+}
+
+
+void File::Pack::addDictionary(
+	const string& name,
+	const vector<vector<uint8_t>>& samples,
+	size_t capacity)
+{
+	auto trained = trainDictionary(samples, capacity);
+	clearDictionary();
+	add(name, trained, 0);
+	dictionaryName = name;
+	dictionary = move(trained);
+}
+
+void File::Pack::clearDictionary()
+{
+	dictionaryName.clear();
+	dictionary.clear();
+}
+
+void File::Pack::setCompressionTarget(const CompressionTarget& target)
+{
+	compressionTarget = target;
+}
+
+void File::Pack::clearCompressionTarget()
+{
+	compressionTarget.reset();
+}
+
+void File::Pack::copy(const Pack& source, const string& name, const string& prefix)
+{
+	TRACE_ZONE("pack/copy");
+
+	const auto newName = prefix + name;
+	if (!file)
+		throw runtime_error("Pack is not open for writing");
+	if (find(newName) != nullptr)
+		throw runtime_error("Block already exists");
+	if (streaming)
+		throw runtime_error("Another block is being streamed");
+
+	const auto* from = source.find(name);
+	if (!from)
+		throw runtime_error("Block not found");
+
+	vector<uint8_t> buffer;
+	const auto* data = source.stored(*from, buffer);
+
+	index.emplace(newName, blocks.size());
+	auto& block = blocks.emplace_back(*from);
+	block.name = newName;
+	block.offset = currentWritePosition;
+	if (block.compression.compare(0, 5, "zstd:") == 0)
+		block.compression.insert(5, prefix);
+
+	fseek(*file, block.offset, SEEK_SET);
+	fwrite(data, block.compressedSize, 1, *file);
+
+	currentWritePosition += block.compressedSize;
+	dirty = true;
+
+	TRACE_COUNT("pack bytes written", block.compressedSize);
+}
+
+
+File::Pack::Stream::Stream(
+	Pack& pack,
+	const string& name,
+	const char* typeinfo,
+	int compression)
+	: pack(pack)
+{
+	if (!pack.file)
+		throw runtime_error("Pack is not open for writing");
+	if (pack.find(name) != nullptr)
+		throw runtime_error("Block already exists");
+	if (pack.streaming)
+		throw runtime_error("Another block is being streamed");
+
+	block = pack.blocks.size();
+	pack.index.emplace(name, block);
+	auto& added = pack.blocks.emplace_back();
+	added.name = name;
+	added.typeinfo = demangle(typeinfo);
+	added.offset = pack.currentWritePosition;
+	added.compressedSize = 0;
+
+	if (compression)
+	{
+		added.compression = "brotli";
+		compressor = make_unique<Compressor>(
+			Compression::Brotli,
+			compression,
+			[this](const uint8_t* data, size_t size) { append(data, size); });
+	}
+
+	fseek(*pack.file, added.offset, SEEK_SET);
+	pack.streaming = true;
+	pack.dirty = true;
+}
+
+File::Pack::Stream::~Stream()
+{
+	finish();
+}
+
+void File::Pack::Stream::write(const void* data, size_t size)
+{
+	TRACE_ZONE("pack/stream");
+
+	if (!open)
+		throw runtime_error("Stream already finished");
+
+	if (compressor)
+		compressor->write((const uint8_t*)data, size);
+	else
+		append((const uint8_t*)data, size);
+}
+
+void File::Pack::Stream::append(const uint8_t* data, size_t size)
+{
+	// nothing else moves the file position while the stream is open
+	fwrite(data, size, 1, *pack.file);
+	pack.blocks[block].compressedSize += size;
+	pack.currentWritePosition += size;
+
+	TRACE_COUNT("pack bytes written", size);
+}
+
+void File::Pack::Stream::finish()
+{
+	if (!open)
+		return;
+
+	if (compressor)
+		compressor->finish();
+	open = false;
+	pack.streaming = false;
 }
 
 
@@ -181,6 +392,8 @@ void File::Pack::flush()
 {
 	if (dirty)
 	{
+		TRACE_ZONE("pack/flush");
+
 		stringstream descriptors;
 
 		for (auto& block: blocks)
@@ -197,7 +410,7 @@ void File::Pack::flush()
 		}
 		else
 		{
-			const auto buffer = compress(descriptors.str());
+			const auto buffer = compress(descriptors.str(), Compression::Brotli);
 			fwrite(buffer.data(), buffer.size(), 1, *file);
 		}
 
@@ -0,0 +1,264 @@
+#include "Memory.h"
+
+#if defined(ENABLE_MEMORY_STATS)
+
+#	include <algorithm>
+#	include <atomic>
+#	include <cstdio>
+#	include <cstdlib>
+#	include <cstring>
+#	include <mutex>
+#	include <new>
+#	include <stdint.h>
+
+using namespace std;
+
+
+namespace
+{
+	// nothing in here may allocate through operator new, hence the fixed-size tables
+
+	constexpr int maxStages = 128;
+	constexpr int maxThreads = 256;
+
+	struct Counters
+	{
+		atomic<int64_t> allocations { 0 };
+		atomic<int64_t> bytes { 0 };
+		atomic<int64_t> current { 0 };
+		atomic<int64_t> peak { 0 };
+
+		void add(int64_t size)
+		{
+			allocations.fetch_add(1, memory_order_relaxed);
+			bytes.fetch_add(size, memory_order_relaxed);
+			const auto now = current.fetch_add(size, memory_order_relaxed) + size;
+			auto highest = peak.load(memory_order_relaxed);
+			while (now > highest
+				   && !peak.compare_exchange_weak(highest, now, memory_order_relaxed))
+				;
+		}
+
+		void remove(int64_t size) { current.fetch_sub(size, memory_order_relaxed); }
+
+		void reset()
+		{
+			allocations = 0;
+			bytes = 0;
+			peak = current.load();
+		}
+
+		void print(const char* name) const
+		{
+			printf(
+				"  %-30s %10lld %12.2f %12.2f %12.2f\n",
+				name,
+				(long long)allocations.load(),
+				bytes / 1048576.,
+				peak / 1048576.,
+				current / 1048576.);
+		}
+	};
+
+	mutex stageMutex;
+	const char* stageNames[maxStages] = { "(no stage)" };
+	int stageCount = 1;
+
+	Counters stages[maxStages];
+	Counters threads[maxThreads];
+	Counters total;
+	atomic<int> threadCount { 0 };
+
+	thread_local int currentStage = 0;
+	thread_local int threadSlot = -1;
+
+	int thisThread()
+	{
+		if (threadSlot < 0)
+			threadSlot = min(threadCount.fetch_add(1), maxThreads - 1);
+		return threadSlot;
+	}
+
+	// precedes every counted block; 16 bytes keep the default alignment of operator new
+	struct Header
+	{
+		uint64_t size;
+		uint16_t stage;
+		uint16_t thread;
+		uint32_t offset;  // from the start of the underlying malloc block
+	};
+	static_assert(sizeof(Header) == 16, "Header must preserve 16-byte alignment");
+
+	void* track(void* raw, size_t size, size_t offset)
+	{
+		if (!raw)
+			return nullptr;
+
+		auto user = (char*)raw + offset;
+		auto header = (Header*)user - 1;
+		header->size = size;
+		header->stage = (uint16_t)currentStage;
+		header->thread = (uint16_t)thisThread();
+		header->offset = (uint32_t)offset;
+
+		stages[header->stage].add(size);
+		threads[header->thread].add(size);
+		total.add(size);
+		return user;
+	}
+
+	void forget(const Header& header)
+	{
+		stages[header.stage].remove(header.size);
+		threads[header.thread].remove(header.size);
+		total.remove(header.size);
+	}
+
+	void* untrack(void* user)
+	{
+		auto header = (Header*)user - 1;
+		forget(*header);
+		return (char*)user - header->offset;
+	}
+
+	void* allocateAligned(size_t size, size_t alignment)
+	{
+		if (alignment <= sizeof(Header))
+			return track(malloc(sizeof(Header) + size), size, sizeof(Header));
+
+		// header goes right before the first aligned address that leaves room for it
+		auto raw = malloc(size + alignment + sizeof(Header));
+		if (!raw)
+			return nullptr;
+		const auto start = (uintptr_t)raw + sizeof(Header);
+		const auto aligned = (start + alignment - 1) / alignment * alignment;
+		return track(raw, size, aligned - (uintptr_t)raw);
+	}
+
+	void releaseAny(void* pointer)
+	{
+		if (pointer)
+			free(untrack(pointer));
+	}
+
+	void* allocateOrThrow(size_t size, size_t alignment)
+	{
+		auto pointer = allocateAligned(size ? size : 1, alignment);
+		if (!pointer)
+			throw bad_alloc();
+		return pointer;
+	}
+}
+
+
+Memory::Stage::Stage(int id) : previous(currentStage)
+{
+	currentStage = id;
+}
+
+Memory::Stage::~Stage()
+{
+	currentStage = previous;
+}
+
+int Memory::stageId(const char* name)
+{
+	lock_guard<mutex> lock(stageMutex);
+	for (int i = 0; i < stageCount; i++)
+		if (strcmp(stageNames[i], name) == 0)
+			return i;
+	if (stageCount == maxStages)
+		return 0;
+	stageNames[stageCount] = name;
+	return stageCount++;
+}
+
+
+void* Memory::allocate(size_t size)
+{
+	return allocateAligned(size, sizeof(Header));
+}
+
+void* Memory::reallocate(void* pointer, size_t size)
+{
+	if (!pointer)
+		return allocate(size);
+	// the old block stays counted until realloc succeeds, it is still live otherwise
+	const auto old = *((Header*)pointer - 1);
+	auto raw = realloc((char*)pointer - old.offset, sizeof(Header) + size);
+	if (!raw)
+		return nullptr;
+	forget(old);
+	return track(raw, size, sizeof(Header));
+}
+
+void Memory::release(void* pointer)
+{
+	releaseAny(pointer);
+}
+
+
+void Memory::report(const char* title)
+{
+	printf("Memory for '%s'\n", title);
+	printf(
+		"  %-30s %10s %12s %12s %12s\n",
+		"stage",
+		"allocations",
+		"allocated MB",
+		"peak MB",
+		"live MB");
+
+	int count = 0;
+	{
+		lock_guard<mutex> lock(stageMutex);
+		count = stageCount;
+	}
+	for (int i = 0; i < count; i++)
+		if (stages[i].allocations || stages[i].current)
+			stages[i].print(stageNames[i]);
+
+	char name[32];
+	const auto numThreads = min(threadCount.load(), maxThreads);
+	for (int i = 0; i < numThreads; i++)
+		if (threads[i].allocations)
+		{
+			snprintf(name, sizeof(name), "thread %d", i);
+			threads[i].print(name);
+		}
+
+	total.print("total");
+
+	for (auto& stage: stages)
+		stage.reset();
+	for (auto& thread: threads)
+		thread.reset();
+	total.reset();
+}
+
+
+// clang-format off
+void* operator new(size_t size) { return allocateOrThrow(size, sizeof(Header)); }
+void* operator new[](size_t size) { return allocateOrThrow(size, sizeof(Header)); }
+void* operator new(size_t size, align_val_t al) { return allocateOrThrow(size, (size_t)al); }
+void* operator new[](size_t size, align_val_t al) { return allocateOrThrow(size, (size_t)al); }
+void* operator new(size_t size, const nothrow_t&) noexcept { return allocateAligned(size ? size : 1, sizeof(Header)); }
+void* operator new[](size_t size, const nothrow_t&) noexcept { return allocateAligned(size ? size : 1, sizeof(Header)); }
+void* operator new(size_t size, align_val_t al, const nothrow_t&) noexcept { return allocateAligned(size ? size : 1, (size_t)al); }
+void* operator new[](size_t size, align_val_t al, const nothrow_t&) noexcept { return allocateAligned(size ? size : 1, (size_t)al); }
+
+void operator delete(void* p) noexcept { releaseAny(p); }
+void operator delete[](void* p) noexcept { releaseAny(p); }
+void operator delete(void* p, size_t) noexcept { releaseAny(p); }
+void operator delete[](void* p, size_t) noexcept { releaseAny(p); }
+void operator delete(void* p, align_val_t) noexcept { releaseAny(p); }
+void operator delete[](void* p, align_val_t) noexcept { releaseAny(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { releaseAny(p); }
+void operator delete[](void* p, size_t, align_val_t) noexcept { releaseAny(p); }
+void operator delete(void* p, const nothrow_t&) noexcept { releaseAny(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { releaseAny(p); }
+void operator delete(void* p, align_val_t, const nothrow_t&) noexcept { releaseAny(p); }
+void operator delete[](void* p, align_val_t, const nothrow_t&) noexcept { releaseAny(p); }
+// clang-format on
+
+#endif
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+
+
+// Allocation accounting per pipeline stage and per thread. Define ENABLE_MEMORY_STATS (CMake
+// option of the same name) to replace the global operator new/delete with counting versions;
+// otherwise the macros expand to nothing. Every allocation is charged to the innermost
+// stage of the allocating thread and released from that same stage, wherever it is freed.
+// Trace zones (TRACE_ZONE) open a stage of the same name, so they need no extra markup.
+//
+//     MEMORY_STAGE("union");                 // charge allocations in this scope to "union"
+//     MEMORY_REPORT("Lato-Regular.ttf");     // print per-stage and per-thread table, reset
+
+#if defined(ENABLE_MEMORY_STATS)
+
+namespace Memory
+{
+	class Stage
+	{
+	public:
+		Stage(int id);
+		~Stage();
+
+		Stage(const Stage&) = delete;
+		Stage& operator=(const Stage&) = delete;
+
+	private:
+		int previous;
+	};
+
+	int stageId(const char* name);
+
+	// counted malloc/realloc/free for C libraries that accept allocator callbacks
+	void* allocate(size_t size);
+	void* reallocate(void* pointer, size_t size);
+	void release(void* pointer);
+
+	// prints counts, bytes and high-water marks, then starts a new measurement period
+	void report(const char* title);
+}
+
+#	define MEMORY_CONCAT_(a, b) a##b
+#	define MEMORY_CONCAT(a, b) MEMORY_CONCAT_(a, b)
+#	define MEMORY_STAGE(name)                                                      \
+		static const int MEMORY_CONCAT(memoryStageId, __LINE__) = Memory::stageId(name); \
+		Memory::Stage MEMORY_CONCAT(memoryStage, __LINE__)(MEMORY_CONCAT(memoryStageId, __LINE__))
+#	define MEMORY_REPORT(title) Memory::report(title)
+
+#else
+
+#	define MEMORY_STAGE(name)
+#	define MEMORY_REPORT(title)
+
+#endif
@@ -0,0 +1,168 @@
+#include "Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+namespace
+{
+	class Pool
+	{
+	public:
+		Pool(unsigned helpers)
+		{
+			for (unsigned i = 0; i < helpers; i++)
+				workers.emplace_back([this]() { work(); });
+		}
+
+		~Pool()
+		{
+			{
+				lock_guard<mutex> lock(queueMutex);
+				stopping = true;
+			}
+			wakeUp.notify_all();
+			for (auto& worker: workers)
+				worker.join();
+		}
+
+		void submit(function<void()> task)
+		{
+			{
+				lock_guard<mutex> lock(queueMutex);
+				tasks.push_back(move(task));
+			}
+			wakeUp.notify_one();
+		}
+
+		size_t size() const { return workers.size(); }
+
+	private:
+		void work()
+		{
+			while (true)
+			{
+				function<void()> task;
+				{
+					unique_lock<mutex> lock(queueMutex);
+					wakeUp.wait(lock, [this]() { return stopping || !tasks.empty(); });
+					if (tasks.empty())
+						return;
+					task = move(tasks.front());
+					tasks.pop_front();
+				}
+				task();
+			}
+		}
+
+		vector<thread> workers;
+		deque<function<void()>> tasks;
+		mutex queueMutex;
+		condition_variable wakeUp;
+		bool stopping = false;
+	};
+
+	mutex poolMutex;
+	unsigned requestedThreads = 0;
+	unique_ptr<Pool> pool;
+
+	Pool& getPool()
+	{
+		lock_guard<mutex> lock(poolMutex);
+		if (!pool)
+		{
+			const auto count = requestedThreads ? requestedThreads : thread::hardware_concurrency();
+			pool = make_unique<Pool>(max(count, 1u) - 1);
+		}
+		return *pool;
+	}
+
+	// shared by the caller and every helper taking part in one forEach call
+	struct Job
+	{
+		const std::function<void(size_t)>& body;
+		const size_t count;
+
+		atomic<size_t> next { 0 };
+		atomic<size_t> finished { 0 };
+
+		mutex doneMutex;
+		condition_variable done;
+		exception_ptr error;
+
+		Job(const std::function<void(size_t)>& function, size_t count)
+			: body(function),
+			  count(count)
+		{}
+
+		void run()
+		{
+			size_t completed = 0;
+			for (size_t i; (i = next++) < count; completed++)
+			{
+				try
+				{
+					body(i);
+				}
+				catch (...)
+				{
+					lock_guard<mutex> lock(doneMutex);
+					if (!error)
+						error = current_exception();
+				}
+			}
+
+			if (completed && (finished += completed) == count)
+			{
+				lock_guard<mutex> lock(doneMutex);
+				done.notify_all();
+			}
+		}
+	};
+}
+
+
+unsigned Parallel::threadCount()
+{
+	return (unsigned)getPool().size() + 1;
+}
+
+void Parallel::setThreadCount(unsigned count)
+{
+	lock_guard<mutex> lock(poolMutex);
+	requestedThreads = count;
+	pool.reset();
+}
+
+
+void Parallel::forEach(size_t count, const std::function<void(size_t)>& function)
+{
+	if (count == 0)
+		return;
+
+	auto& workers = getPool();
+	const auto helpers = min(workers.size(), count - 1);
+	if (helpers == 0)
+	{
+		for (size_t i = 0; i < count; i++)
+			function(i);
+		return;
+	}
+
+	auto job = make_shared<Job>(function, count);
+	for (size_t i = 0; i < helpers; i++)
+		workers.submit([job]() { job->run(); });
+	job->run();
+
+	unique_lock<mutex> lock(job->doneMutex);
+	job->done.wait(lock, [&]() { return job->finished == count; });
+	if (job->error)
+		rethrow_exception(job->error);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <functional>
+#include <stddef.h>
+
+
+// Process-wide worker pool. The calling thread always takes part in the work, so nested
+// calls and calls from inside workers cannot deadlock; they just get less help.
+namespace Parallel
+{
+	// number of threads used, including the caller; defaults to the hardware concurrency.
+	// Change it only while no parallel work is running.
+	unsigned threadCount();
+	void setThreadCount(unsigned count);
+
+	// Call function(i) for every i in [0, count) and return when all calls have finished.
+	// Indices are handed out one at a time, so uneven costs balance out. The first exception
+	// thrown by a call is rethrown here after the remaining calls finish.
+	void forEach(size_t count, const std::function<void(size_t)>& function);
+}
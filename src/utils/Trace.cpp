@@ -0,0 +1,177 @@
+#include "Trace.h"
+
+#if defined(ENABLE_TRACING)
+
+#	include "File.h"
+#	include <algorithm>
+#	include <chrono>
+#	include <map>
+#	include <memory>
+#	include <mutex>
+#	include <sstream>
+#	include <string>
+#	include <unordered_map>
+#	include <vector>
+
+using namespace std;
+
+
+namespace
+{
+	struct Event
+	{
+		const char* name;
+		int64_t start;
+		int64_t duration;
+	};
+
+	struct ThreadBuffer
+	{
+		uint32_t id;
+		vector<Event> events;
+		unordered_map<const char*, int64_t> counters;
+	};
+
+	// buffers outlive their threads, so zones recorded by finished workers can be exported
+	mutex registryMutex;
+	vector<unique_ptr<ThreadBuffer>> registry;
+
+	ThreadBuffer& threadBuffer()
+	{
+		thread_local ThreadBuffer* buffer = nullptr;
+		if (!buffer)
+		{
+			lock_guard<mutex> lock(registryMutex);
+			auto& entry = registry.emplace_back(make_unique<ThreadBuffer>());
+			entry->id = (uint32_t)registry.size();
+			entry->events.reserve(1024);
+			buffer = entry.get();
+		}
+		return *buffer;
+	}
+
+	int64_t now()
+	{
+		static const auto epoch = chrono::steady_clock::now();
+		return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch)
+			.count();
+	}
+
+	string escape(const char* text)
+	{
+		string output;
+		for (; *text; text++)
+		{
+			if (*text == '"' || *text == '\\')
+				output += '\\';
+			output += *text;
+		}
+		return output;
+	}
+
+	map<string, int64_t> totalCounters()
+	{
+		map<string, int64_t> totals;
+		for (auto& buffer: registry)
+			for (auto& [name, value]: buffer->counters)
+				totals[name] += value;
+		return totals;
+	}
+}
+
+
+Trace::Zone::Zone(const char* name) : name(name), start(now()) {}
+
+Trace::Zone::~Zone()
+{
+	const auto end = now();
+	threadBuffer().events.push_back({ name, start, end - start });
+}
+
+void Trace::count(const char* name, int64_t value)
+{
+	threadBuffer().counters[name] += value;
+}
+
+
+void Trace::writeChromeTrace(const filesystem::path& filename)
+{
+	lock_guard<mutex> lock(registryMutex);
+
+	ostringstream json;
+	json << "{\"traceEvents\":[\n";
+
+	int64_t last = 0;
+	for (auto& buffer: registry)
+	{
+		json << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+			 << ",\"args\":{\"name\":\"thread " << buffer->id << "\"}},\n";
+
+		for (auto& event: buffer->events)
+		{
+			json << "{\"name\":\"" << escape(event.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+				 << buffer->id << ",\"ts\":" << event.start / 1000.
+				 << ",\"dur\":" << event.duration / 1000. << "},\n";
+			last = max(last, event.start + event.duration);
+		}
+	}
+
+	for (auto& [name, value]: totalCounters())
+		json << "{\"name\":\"" << escape(name.c_str()) << "\",\"ph\":\"C\",\"pid\":1,\"ts\":"
+			 << last / 1000. << ",\"args\":{\"value\":" << value << "}},\n";
+
+	// trailing metadata event avoids special-casing the comma of the last real event
+	json << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+		 << "\"args\":{\"name\":\"conversion\"}}\n";
+	json << "],\"displayTimeUnit\":\"ms\"}\n";
+
+	File::writeAll(json.str(), filename);
+}
+
+
+void Trace::printSummary()
+{
+	lock_guard<mutex> lock(registryMutex);
+
+	struct Stats
+	{
+		size_t calls = 0;
+		int64_t total = 0;
+		int64_t longest = 0;
+	};
+	map<string, Stats> zones;
+	for (auto& buffer: registry)
+		for (auto& event: buffer->events)
+		{
+			auto& stats = zones[event.name];
+			stats.calls++;
+			stats.total += event.duration;
+			stats.longest = max(stats.longest, event.duration);
+		}
+
+	printf("%-32s %10s %12s %12s %12s\n", "zone", "calls", "total ms", "mean us", "max us");
+	for (auto& [name, stats]: zones)
+		printf(
+			"%-32s %10zu %12.3f %12.3f %12.3f\n",
+			name.c_str(),
+			stats.calls,
+			stats.total / 1e6,
+			stats.total / 1e3 / stats.calls,
+			stats.longest / 1e3);
+
+	for (auto& [name, value]: totalCounters())
+		printf("%-32s %10lld\n", name.c_str(), (long long)value);
+}
+
+
+void Trace::clear()
+{
+	lock_guard<mutex> lock(registryMutex);
+	for (auto& buffer: registry)
+	{
+		buffer->events.clear();
+		buffer->counters.clear();
+	}
+}
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Memory.h"
+#include <filesystem>
+#include <stdint.h>
+
+
+// Scoped timing zones and counters for the conversion pipeline. Every thread records into
+// its own buffer; the buffers are merged only when exporting, which should happen after
+// worker threads have finished. Define ENABLE_TRACING (CMake option of the same name) to
+// compile them in, otherwise the macros expand to nothing. Zones also open a memory stage
+// of the same name when ENABLE_MEMORY_STATS is defined (see Memory.h).
+//
+//     TRACE_ZONE("union");             // times the enclosing scope
+//     TRACE_COUNT("triangles", n);     // adds n to a counter
+//     TRACE_EXPORT("trace.json");      // Chrome trace-event JSON and a summary on stdout
+
+#if defined(ENABLE_TRACING)
+
+namespace Trace
+{
+	class Zone
+	{
+	public:
+		Zone(const char* name);
+		~Zone();
+
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+
+	private:
+		const char* name;
+		int64_t start;
+	};
+
+	void count(const char* name, int64_t value);
+
+	// open in chrome://tracing or https://ui.perfetto.dev
+	void writeChromeTrace(const std::filesystem::path& filename);
+	void printSummary();
+	void clear();
+}
+
+#	define TRACE_CONCAT_(a, b) a##b
+#	define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#	define TRACE_ZONE(name)                                \
+		Trace::Zone TRACE_CONCAT(traceZone, __LINE__)(name); \
+		MEMORY_STAGE(name)
+#	define TRACE_COUNT(name, value) Trace::count(name, (int64_t)(value))
+#	define TRACE_EXPORT(filename) (Trace::writeChromeTrace(filename), Trace::printSummary())
+
+#else
+
+#	define TRACE_ZONE(name) MEMORY_STAGE(name)
+#	define TRACE_COUNT(name, value)
+#	define TRACE_EXPORT(filename)
+
+#endif
@@ -65,6 +65,14 @@
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
+
+#if defined(TTF_LINUX) || defined(TTF_ANDROID)
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
 
 #if defined(TTF_NO_SIGNAL_H)
 #   define TTF_BREAKPOINT
@@ -1052,6 +1060,11 @@ int parse_composite_glyph(ttf_t *ttf, ttf_glyph_t *glyph, uint8_t *p, int avail)
     return 0;
 }
 
+static int loca_offset(const pps_t *pp, int i)
+{
+    return pp->ploca16 ? big16toh(pp->ploca16[i]) * 2 : (int)big32toh(pp->ploca32[i]);
+}
+
 int parse_glyf_table(ttf_t *ttf, pps_t *pp)
 {
     int i;
@@ -1062,20 +1075,10 @@ int parse_glyf_table(ttf_t *ttf, pps_t *pp)
     /* read simple glyphs from table */
     for (i = 0; i < ttf->nglyphs; i++)
     {
-        if (pp->ploca16)
-        {
-            offset = pp->ploca16[i] * 2;
-            if (i < ttf->nglyphs - 1)
-                if (pp->ploca16[i] == pp->ploca16[i + 1])
-                    continue; /* glyph has no outline */
-        }
-        else
-        {
-            offset = pp->ploca32[i];
-            if (i < ttf->nglyphs - 1)
-                if (pp->ploca32[i] == pp->ploca32[i + 1])
-                    continue; /* glyph has no outline */
-        }
+        offset = loca_offset(pp, i);
+        if (i < ttf->nglyphs - 1)
+            if (offset == loca_offset(pp, i + 1))
+                continue; /* glyph has no outline */
         if (offset == pp->sglyf) continue; /* glyph has no outline */
         if (offset + (int)sizeof(ttf_glyfh_t) >= pp->sglyf)
             continue; /* strict parser must return TTF_ERR_FMT */
@@ -1088,7 +1091,7 @@ int parse_glyf_table(ttf_t *ttf, pps_t *pp)
     /* read composite glyphs */
     for (i = 0; i < ttf->nglyphs; i++)
     {
-        offset = pp->ploca16 ? pp->ploca16[i] * 2 : pp->ploca32[i];
+        offset = loca_offset(pp, i);
         if (offset == pp->sglyf) continue;
         if (offset + (int)sizeof(ttf_glyfh_t) >= pp->sglyf)
             continue; /* strict parser must return TTF_ERR_FMT */
@@ -1136,26 +1139,28 @@ static int parse_hmtx_table(ttf_t *ttf, pps_t *pp)
     int size, i;
     float adv, lsb;
     uint16_t *p;
+    ttf_hhea_t hhea;
     if (pp->shhea < (int)sizeof(ttf_hhea_t)) return TTF_ERR_FMT;
-    conv16(pp->phhea->majorVersion);
-    conv16(pp->phhea->minorVersion);
-    conv16(pp->phhea->ascender);
-    conv16(pp->phhea->descender);
-    conv16(pp->phhea->lineGap);
-    conv16(pp->phhea->advanceWidthMax);
-    conv16(pp->phhea->minLeftSideBearing);
-    conv16(pp->phhea->minRightSideBearing);
-    conv16(pp->phhea->xMaxExtent);
-    conv16(pp->phhea->caretSlopeRise);
-    conv16(pp->phhea->caretSlopeRun);
-    conv16(pp->phhea->caretOffset);
-    conv16(pp->phhea->metricDataFormat);
-    conv16(pp->phhea->numberOfHMetrics);
-    if (pp->phhea->numberOfHMetrics == 0 || (int)pp->phhea->numberOfHMetrics > ttf->nglyphs) return TTF_ERR_FMT;
-    size = (int)pp->phhea->numberOfHMetrics * 4 + (ttf->nglyphs - pp->phhea->numberOfHMetrics) * 2;
+    hhea = *pp->phhea;
+    conv16(hhea.majorVersion);
+    conv16(hhea.minorVersion);
+    conv16(hhea.ascender);
+    conv16(hhea.descender);
+    conv16(hhea.lineGap);
+    conv16(hhea.advanceWidthMax);
+    conv16(hhea.minLeftSideBearing);
+    conv16(hhea.minRightSideBearing);
+    conv16(hhea.xMaxExtent);
+    conv16(hhea.caretSlopeRise);
+    conv16(hhea.caretSlopeRun);
+    conv16(hhea.caretOffset);
+    conv16(hhea.metricDataFormat);
+    conv16(hhea.numberOfHMetrics);
+    if (hhea.numberOfHMetrics == 0 || (int)hhea.numberOfHMetrics > ttf->nglyphs) return TTF_ERR_FMT;
+    size = (int)hhea.numberOfHMetrics * 4 + (ttf->nglyphs - hhea.numberOfHMetrics) * 2;
     if (pp->shmtx != size) return TTF_ERR_FMT;
     p = pp->phmtx;
-    for (i = 0; i < (int)pp->phhea->numberOfHMetrics; i++)
+    for (i = 0; i < (int)hhea.numberOfHMetrics; i++)
     {
         adv = big16toh(*p++);
         lsb = (int16_t)big16toh(*p++);
@@ -1169,17 +1174,17 @@ static int parse_hmtx_table(ttf_t *ttf, pps_t *pp)
         ttf->glyphs[i].lbearing = lsb;
     }
 
-    ttf->hhea.ascender = pp->phhea->ascender;
-    ttf->hhea.descender = pp->phhea->descender;
-    ttf->hhea.lineGap = pp->phhea->lineGap;
-    ttf->hhea.advanceWidthMax = pp->phhea->advanceWidthMax;
-    ttf->hhea.minLSideBearing = pp->phhea->minLeftSideBearing;
-    ttf->hhea.minRSideBearing = pp->phhea->minRightSideBearing;
-    ttf->hhea.xMaxExtent = pp->phhea->xMaxExtent;
+    ttf->hhea.ascender = hhea.ascender;
+    ttf->hhea.descender = hhea.descender;
+    ttf->hhea.lineGap = hhea.lineGap;
+    ttf->hhea.advanceWidthMax = hhea.advanceWidthMax;
+    ttf->hhea.minLSideBearing = hhea.minLeftSideBearing;
+    ttf->hhea.minRSideBearing = hhea.minRightSideBearing;
+    ttf->hhea.xMaxExtent = hhea.xMaxExtent;
 
     /* caret slope calculation */
     /* see https://developer.apple.com/fonts/TrueType-Reference-Manual/RM06/Chap6hhea.html */
-    ttf->hhea.caretSlope = atan2f(pp->phhea->caretSlopeRun, pp->phhea->caretSlopeRise);
+    ttf->hhea.caretSlope = atan2f(hhea.caretSlopeRun, hhea.caretSlopeRise);
 
     return TTF_DONE;
 }
@@ -1198,24 +1203,25 @@ static int ttf_extract_tables(const uint8_t *data, int size, pps_t *s)
     if (ntab * sizeof(ttf_tab_rec_t) + sizeof(ttf_file_hdr_t) > (size_t)size) return TTF_ERR_FMT;
     rec = (ttf_tab_rec_t *)(s->hdr + 1);
 
+    /* the records are read without converting them in place: data may be read-only */
     #define check_tag(str) (*(uint32_t *)rec->tableTag != *(uint32_t *)str)
     #define match(type, name, str) \
     if (*(uint32_t *)rec->tableTag == *(uint32_t *)str) \
     { \
-        s->s##name = rec->length; \
-        s->p##name = (type)(data + rec->offset); \
+        s->s##name = length; \
+        s->p##name = (type)(data + offset); \
     }
 
     while (ntab--)
     {
-        conv32(rec->checkSum);
-        conv32(rec->offset);
-        conv32(rec->length);
-        if (rec->offset > (uint32_t)size || rec->length > (uint32_t)size)
+        uint32_t checkSum = big32toh(rec->checkSum);
+        uint32_t offset = big32toh(rec->offset);
+        uint32_t length = big32toh(rec->length);
+        if (offset > (uint32_t)size || length > (uint32_t)size)
             return TTF_ERR_FMT;
-        if (rec->offset + rec->length > (uint32_t)size) return TTF_ERR_FMT;
+        if (offset + length > (uint32_t)size) return TTF_ERR_FMT;
         if (check_tag("head"))
-            if (ttf_checksum(data + rec->offset, rec->length) != rec->checkSum)
+            if (ttf_checksum(data + offset, length) != checkSum)
                 return TTF_ERR_CSUM;
         match(ttf_cmap_t *, cmap, "cmap");
         match(ttf_head_t *, head, "head");
@@ -1227,7 +1233,7 @@ static int ttf_extract_tables(const uint8_t *data, int size, pps_t *s)
         match(uint8_t *, loca, "loca");
         match(uint8_t *, glyf, "glyf");
         if (check_tag("glyf"))
-            s->glyf_csum = rec->checkSum;
+            s->glyf_csum = checkSum;
         rec++;
     }
     #undef match
@@ -1279,35 +1285,32 @@ static int parse_fmt4(ttf_t *ttf, uint8_t *data, int dataSize, bool headers_only
     int16_t *idDelta; /* Delta for all character codes in segment */
     uint16_t *idRangeOffset; /* Offsets into glyphIdArray or 0 */
     uint16_t *glyphIdArray; /* Glyph index array (arbitrary length) */
-    int segCount, idArrayLen;
+    int length, segCount, idArrayLen;
     int i, j, k;
 
     if (dataSize < (int)sizeof(ttf_fmt4_t)) return TTF_ERR_FMT;
     tab = (ttf_fmt4_t *)data;
-    conv16(tab->length);
-    conv16(tab->segCountX2);
-    if (tab->length > dataSize)
+    length = big16toh(tab->length);
+    if (length > dataSize)
         return TTF_ERR_FMT;
-    segCount = tab->segCountX2 / 2;
+    segCount = big16toh(tab->segCountX2) / 2;
     endCode = (uint16_t *)(tab + 1);
     startCode = (uint16_t *)(endCode + segCount + 1);
     idDelta = (int16_t *)(startCode + segCount);
     idRangeOffset = (uint16_t *)(idDelta + segCount);
     glyphIdArray = (uint16_t *)(idRangeOffset + segCount);
-    idArrayLen = (tab->length / sizeof(uint16_t) - (glyphIdArray - (uint16_t *)data));
+    idArrayLen = (length / sizeof(uint16_t) - (glyphIdArray - (uint16_t *)data));
     if (idArrayLen < 0) return TTF_ERR_FMT;
 
     k = 0;
     for (i = 0; i < segCount; i++)
     {
-        conv16(endCode[i]);
-        conv16(startCode[i]);
-        conv16(idDelta[i]);
-        conv16(idRangeOffset[i]);
-        if (i == segCount - 1 && startCode[i] != 0xFFFF)
+        int start = big16toh(startCode[i]);
+        int end = big16toh(endCode[i]);
+        if (i == segCount - 1 && start != 0xFFFF)
             return TTF_ERR_FMT;
-        if (startCode[i] == 0xFFFF) break;
-        for (j = startCode[i]; j <= endCode[i]; j++)
+        if (start == 0xFFFF) break;
+        for (j = start; j <= end; j++)
         {
             int range = find_ubrange(j);
             if (range >= 0)
@@ -1324,18 +1327,22 @@ static int parse_fmt4(ttf_t *ttf, uint8_t *data, int dataSize, bool headers_only
     k = 0;
     for (i = 0; i < segCount; i++)
     {
-        if (startCode[i] == 0xFFFF) break;
-        for (j = 0; j <= endCode[i] - startCode[i]; j++)
+        int start = big16toh(startCode[i]);
+        int end = big16toh(endCode[i]);
+        int delta = (int16_t)big16toh(idDelta[i]);
+        int rangeOffset = big16toh(idRangeOffset[i]);
+        if (start == 0xFFFF) break;
+        for (j = 0; j <= end - start; j++)
         {
             if (k >= ttf->nchars) return TTF_ERR_FMT; /* internal error? */
-            ttf->chars[k] = startCode[i] + j;
-            if (idRangeOffset[i] == 0)
+            ttf->chars[k] = start + j;
+            if (rangeOffset == 0)
             {
-                ttf->char2glyph[k] = (uint16_t)(startCode[i] + j + idDelta[i]);
+                ttf->char2glyph[k] = (uint16_t)(start + j + delta);
             }
             else
             {
-                uint16_t *addr = &idRangeOffset[i] + idRangeOffset[i] / 2 + j;
+                uint16_t *addr = &idRangeOffset[i] + rangeOffset / 2 + j;
                 if ((uint8_t *)addr + 2 > data + dataSize)
                     return TTF_ERR_FMT;
                 ttf->char2glyph[k] = big16toh(*addr);
@@ -1357,29 +1364,27 @@ static int parse_fmt4(ttf_t *ttf, uint8_t *data, int dataSize, bool headers_only
 static int parse_fmt12(ttf_t *ttf, uint8_t *data, int dataSize, bool headers_only)
 {
     ttf_fmt12_t *tab;
-    uint32_t smgSize;
+    uint32_t smgSize, numGroups;
     uint32_t i, j, k;
     ttf_fmt12_smg_t *smgs;
 
     if (dataSize < (int)sizeof(ttf_fmt12_t)) return TTF_ERR_FMT;
     tab = (ttf_fmt12_t *)data;
-    conv32(tab->length);
-    conv32(tab->numGroups);
-    if (tab->length > (uint32_t)dataSize)
+    numGroups = big32toh(tab->numGroups);
+    if (big32toh(tab->length) > (uint32_t)dataSize)
         return TTF_ERR_FMT;
 
     smgSize = dataSize - sizeof(ttf_fmt12_t);
-    if (smgSize < sizeof(ttf_fmt12_smg_t) * tab->numGroups)
+    if (smgSize < sizeof(ttf_fmt12_smg_t) * numGroups)
         return TTF_ERR_FMT;
 
     smgs = (ttf_fmt12_smg_t *)(data + sizeof(ttf_fmt12_t));
     k = 0;
-    for (i = 0; i < tab->numGroups; i++)
+    for (i = 0; i < numGroups; i++)
     {
-        conv32(smgs[i].startCharCode);
-        conv32(smgs[i].endCharCode);
-        conv32(smgs[i].startGlyphID);
-        for (j = smgs[i].startCharCode; j <= smgs[i].endCharCode; j++)
+        uint32_t start = big32toh(smgs[i].startCharCode);
+        uint32_t end = big32toh(smgs[i].endCharCode);
+        for (j = start; j <= end; j++)
         {
             int range = find_ubrange(j);
             if (range >= 0)
@@ -1395,14 +1400,17 @@ static int parse_fmt12(ttf_t *ttf, uint8_t *data, int dataSize, bool headers_onl
     ttf->char2glyph = ttf->chars + ttf->nchars;
     memset(ttf->chars, 0, sizeof(uint32_t) * 2 * ttf->nchars);
     k = 0;
-    for (i = 0; i < tab->numGroups; i++)
+    for (i = 0; i < numGroups; i++)
     {
-        if (smgs[i].startCharCode > smgs[i].endCharCode)
+        uint32_t start = big32toh(smgs[i].startCharCode);
+        uint32_t end = big32toh(smgs[i].endCharCode);
+        uint32_t glyph = big32toh(smgs[i].startGlyphID);
+        if (start > end)
             return TTF_ERR_FMT;
-        for(j = 0; j <= smgs[i].endCharCode - smgs[i].startCharCode; j++)
+        for(j = 0; j <= end - start; j++)
         {
-            ttf->chars[k] = smgs[i].startCharCode + j;
-            ttf->char2glyph[k] = smgs[i].startGlyphID + j;
+            ttf->chars[k] = start + j;
+            ttf->char2glyph[k] = glyph + j;
             k++;
         }
     }
@@ -1491,15 +1499,14 @@ static const char *namerec2ascii(const char *p, int len, int platformID, int enc
 
 static bool parse_name(ttf_t *ttf, uint8_t *tab, int tabsize)
 {
-    int i;
+    int i, count, stringOffset;
     ttf_name_t *hdr;
 
     hdr = (ttf_name_t *)tab;
-    conv16(hdr->format);
-    conv16(hdr->count);
-    conv16(hdr->stringOffset);
-    if (hdr->format != 0 && hdr->format != 1) return false;
-    if (hdr->count * (int)sizeof(hdr->nameRecord[0]) + 6 > tabsize) return false;
+    count = big16toh(hdr->count);
+    stringOffset = big16toh(hdr->stringOffset);
+    if (big16toh(hdr->format) != 0 && big16toh(hdr->format) != 1) return false;
+    if (count * (int)sizeof(hdr->nameRecord[0]) + 6 > tabsize) return false;
     ttf->names.copyright = empty_string;
     ttf->names.family = empty_string;
     ttf->names.subfamily = empty_string;
@@ -1516,25 +1523,20 @@ static bool parse_name(ttf_t *ttf, uint8_t *tab, int tabsize)
     ttf->names.license_desc = empty_string;
     ttf->names.locense_url = empty_string;
     ttf->names.sample_text = empty_string;
-    for (i = 0; i < hdr->count; i++)
+    for (i = 0; i < count; i++)
     {
         char *s;
-        conv16(hdr->nameRecord[i].encodingID);
-        conv16(hdr->nameRecord[i].languageID);
-        conv16(hdr->nameRecord[i].length);
-        conv16(hdr->nameRecord[i].nameID);
-        conv16(hdr->nameRecord[i].offset);
-        conv16(hdr->nameRecord[i].platformID);
-        if (hdr->stringOffset +
-            hdr->nameRecord[i].offset +
-            hdr->nameRecord[i].length > tabsize) return false;
-        s = (char *)tab + hdr->stringOffset + hdr->nameRecord[i].offset;
+        int encodingID = big16toh(hdr->nameRecord[i].encodingID);
+        int languageID = big16toh(hdr->nameRecord[i].languageID);
+        int length = big16toh(hdr->nameRecord[i].length);
+        int nameID = big16toh(hdr->nameRecord[i].nameID);
+        int offset = big16toh(hdr->nameRecord[i].offset);
+        int platformID = big16toh(hdr->nameRecord[i].platformID);
+        if (stringOffset + offset + length > tabsize) return false;
+        s = (char *)tab + stringOffset + offset;
         #define match(id, field) \
-        if (hdr->nameRecord[i].nameID == id && ttf->names.field == empty_string) \
-            ttf->names.field = namerec2ascii(s, hdr->nameRecord[i].length, \
-                                             hdr->nameRecord[i].platformID, \
-                                             hdr->nameRecord[i].encodingID, \
-                                             hdr->nameRecord[i].languageID)
+        if (nameID == id && ttf->names.field == empty_string) \
+            ttf->names.field = namerec2ascii(s, length, platformID, encodingID, languageID)
         match(0, copyright);
         match(1, family);
         match(2, subfamily);
@@ -1653,7 +1655,6 @@ int ttf_load_from_mem(const uint8_t *data, int size, ttf_t **output, bool header
     int result;
     ttf_t *ttf;
     pps_t s;
-    int i;
 
     ttf = NULL;
 
@@ -1699,21 +1700,17 @@ int ttf_load_from_mem(const uint8_t *data, int size, ttf_t **output, bool header
 
     if (!headers_only)
     {
-        /* check and convert loca table */
+        /* check loca table, its offsets are converted as they are read */
         check(big16toh(s.phead->indexToLocFormat) <= 1, TTF_ERR_FMT);
         if (s.phead->indexToLocFormat == 0)
         {
             check(s.sloca >= ttf->nglyphs * 2, TTF_ERR_FMT);
             s.ploca16 = (uint16_t *)s.ploca;
-            for (i = 0; i < ttf->nglyphs; i++)
-                conv16(s.ploca16[i]);
         }
         else
         {
             check(s.sloca >= ttf->nglyphs * 4, TTF_ERR_FMT);
             s.ploca32 = (uint32_t *)s.ploca;
-            for (i = 0; i < ttf->nglyphs; i++)
-                conv32(s.ploca32[i]);
         }
 
         /* reading the glyph data */
@@ -1750,12 +1747,91 @@ static bool try_strdup(const char *s, char **dest)
     return true;
 }
 
+/*
+ * The parser reads the font without writing to it, so the file is mapped
+ * read-only and parsed in place: only the pages that are touched get loaded,
+ * and there is no size limit besides the one of ttf_load_from_mem.
+ */
+
+#if defined(TTF_WINDOWS)
+
+int ttf_load_from_file(const char *filename, ttf_t **output, bool headers_only)
+{
+    HANDLE file, mapping;
+    LARGE_INTEGER size;
+    const uint8_t *data;
+    int result;
+
+    mapping = NULL;
+    data = NULL;
+    *output = NULL;
+
+    file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    check(file != INVALID_HANDLE_VALUE, TTF_ERR_OPEN);
+    check(GetFileSizeEx(file, &size), TTF_ERR_OPEN);
+    check(size.QuadPart >= 4 && size.QuadPart <= INT_MAX, TTF_ERR_SIZE);
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    check(mapping != NULL, TTF_ERR_NOMEM);
+    data = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    check(data != NULL, TTF_ERR_NOMEM);
+
+    check(big32toh(*(const uint32_t *)data) == 0x00010000, TTF_ERR_FMT);
+    result = ttf_load_from_mem(data, (int)size.QuadPart, output, headers_only);
+
+    if (*output != NULL)
+        try_strdup(filename, (char **)&(*output)->filename);
+
+error:
+    if (data != NULL)
+        UnmapViewOfFile(data);
+    if (mapping != NULL)
+        CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+    return result;
+}
+
+#elif defined(TTF_LINUX) || defined(TTF_ANDROID)
+
+int ttf_load_from_file(const char *filename, ttf_t **output, bool headers_only)
+{
+    int fd;
+    struct stat st;
+    void *data;
+    int result;
+
+    data = MAP_FAILED;
+    *output = NULL;
+
+    fd = open(filename, O_RDONLY);
+    check(fd >= 0, TTF_ERR_OPEN);
+    check(fstat(fd, &st) == 0, TTF_ERR_OPEN);
+    check(st.st_size >= 4 && st.st_size <= INT_MAX, TTF_ERR_SIZE);
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    check(data != MAP_FAILED, TTF_ERR_NOMEM);
+
+    check(big32toh(*(const uint32_t *)data) == 0x00010000, TTF_ERR_FMT);
+    result = ttf_load_from_mem((const uint8_t *)data, (int)st.st_size, output, headers_only);
+
+    if (*output != NULL)
+        try_strdup(filename, (char **)&(*output)->filename);
+
+error:
+    if (data != MAP_FAILED)
+        munmap(data, st.st_size);
+    if (fd >= 0)
+        close(fd);
+    return result;
+}
+
+#else
+
 int ttf_load_from_file(const char *filename, ttf_t **output, bool headers_only)
 {
     FILE *f;
     int result;
     uint8_t *data;
-    int size;
+    long size;
     uint32_t sfntVersion; /* 0x00010000 or 0x4F54544F ('OTTO') */
 
     data = NULL;
@@ -1768,7 +1844,7 @@ int ttf_load_from_file(const char *filename, ttf_t **output, bool headers_only)
     check(big32toh(sfntVersion) == 0x00010000, TTF_ERR_FMT);
     check(fseek(f, 0, SEEK_END) == 0, TTF_ERR_FMT);
     size = ftell(f);
-    check(size > 0 && size < (TTF_MAX_FILE * 1024 * 1024), TTF_ERR_SIZE);
+    check(size > 0 && size <= INT_MAX, TTF_ERR_SIZE);
     check(fseek(f, 0, SEEK_SET) == 0, TTF_ERR_FMT);
 
     /* allocate memory to file content */
@@ -1779,7 +1855,7 @@ int ttf_load_from_file(const char *filename, ttf_t **output, bool headers_only)
     check(fread(data, 1, size, f) == (size_t)size, TTF_ERR_FMT);
 
     fclose(f);
-    result = ttf_load_from_mem(data, size, output, headers_only);
+    result = ttf_load_from_mem(data, (int)size, output, headers_only);
     free(data);
 
     if (*output != NULL)
@@ -1794,6 +1870,8 @@ error:
     return result;
 }
 
+#endif
+
 #if !defined(TTF_NO_FILESYSTEM)
 
 #ifndef TTF_WINDOWS
@@ -105,13 +105,11 @@ extern "C" {
 
 #define TTF2MESH_VERSION   "1.6"  /* current library version */
 
-#define TTF_MAX_FILE       32     /* font file size limit, MB */
-
 /* return codes of ttf_xxx functions */
 
 #define TTF_DONE           0      /* operation successful */
 #define TTF_ERR_NOMEM      1      /* not enough memory (malloc failed) */
-#define TTF_ERR_SIZE       2      /* file size > TTF_MAX_FILE */
+#define TTF_ERR_SIZE       2      /* file size does not fit in an int */
 #define TTF_ERR_OPEN       3      /* error opening file */
 #define TTF_ERR_VER        4      /* unsupported file version */
 #define TTF_ERR_FMT        5      /* invalid file structure */
@@ -389,7 +387,7 @@ extern const ubrange_t ubranges[163];
 
 /**
  * @brief Load a font from memory
- * @param data Data pointer
+ * @param data Data pointer, only read from, so it may be a read-only mapping
  * @param size Data size
  * @param output Pointer to font object or NULL if error was occurred
  * @return Operation result TTF_XXX
@@ -397,7 +395,7 @@ extern const ubrange_t ubranges[163];
 int ttf_load_from_mem(const uint8_t *data, int size, ttf_t **output, bool headers_only);
 
 /**
- * @brief Load a font from file
+ * @brief Load a font from file, mapping it into memory where the platform allows
  * @param filename TTF font file name
  * @param output Pointer to font object or NULL if error was occurred
  * @return Operation result TTF_XXX